@@ -0,0 +1,21 @@
+/**
+ * @file bench.h
+ * @brief 基准测试程序共用的辅助函数
+ *
+ * 在包含mybash02.c之后包含，直接使用其中的elapsed_seconds。
+ */
+#ifndef MYBASH_BENCH_H
+#define MYBASH_BENCH_H
+
+#include <time.h>
+
+/**
+ * @brief 从start到现在经过的秒数（单调时钟）
+ */
+static inline double seconds_since(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return elapsed_seconds(start, &end);
+}
+
+#endif
@@ -0,0 +1,189 @@
+// Tab补全的速度（JSON输出）
+// 用法: bench/complete_bench [可执行文件数 [目录项数]]
+// 在临时目录中生成一个PATH目录和一个普通目录，测量命令名前缀树的建立、
+// 每次Tab的命令名补全（对比每次readdir + stat扫描PATH）、目录变化后的重建，
+// 以及文件名补全（getdents64的d_type对比readdir + 逐项stat）
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+#include "bench.h"
+
+#define COMPLETE_DEFAULT_EXECS 20000
+#define COMPLETE_DEFAULT_ENTRIES 20000
+
+void report(const char *op, int entries, long ops, int matches, double seconds) {
+    printf("{\"bench\":\"complete\",\"shell\":\"mybash02\",\"op\":\"%s\",\"entries\":%d,"
+           "\"ops\":%ld,\"matches\":%d,\"seconds\":%.6f,\"usec_per_op\":%.2f}\n",
+           op, entries, ops, matches, seconds, seconds * 1e6 / ops);
+    fflush(stdout);
+}
+
+/**
+ * @brief 没有缓存时的命令名补全：每次Tab都readdir扫描PATH各目录并逐项stat
+ */
+int naive_command_matches(const char *path_env, const char *prefix) {
+    size_t plen = strlen(prefix);
+    int matches = 0;
+    char *dirs = strdup(path_env);
+    for (char *dir = strtok(dirs, ":"); dir; dir = strtok(NULL, ":")) {
+        DIR *d = opendir(dir);
+        if (!d) continue;
+        struct dirent *e;
+        while ((e = readdir(d))) {
+            struct stat st;
+            if (strncmp(e->d_name, prefix, plen) == 0 &&
+                fstatat(dirfd(d), e->d_name, &st, 0) == 0 && S_ISREG(st.st_mode) &&
+                (st.st_mode & 0111)) {
+                matches++;
+            }
+        }
+        closedir(d);
+    }
+    free(dirs);
+    return matches;
+}
+
+/**
+ * @brief readdir + 逐项stat的文件名补全，作为getdents64 d_type的对照
+ */
+int naive_file_matches(const char *dir, const char *prefix) {
+    size_t plen = strlen(prefix);
+    int matches = 0;
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        // stat确定是否为目录（补全的目录名后加'/'）
+        struct stat st;
+        if (strncmp(e->d_name, prefix, plen) == 0 && e->d_name[0] != '.' &&
+            fstatat(dirfd(d), e->d_name, &st, 0) == 0) {
+            matches++;
+        }
+    }
+    closedir(d);
+    return matches;
+}
+
+/**
+ * @brief 生成count个文件，每16个中有一个子目录，exec时文件可执行
+ */
+void make_entries(const char *dir, int count, int exec) {
+    char path[PATH_MAX];
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/cmd%05d", dir, i);
+        if (!exec && i % 16 == 0) {
+            mkdir(path, 0755);
+            continue;
+        }
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, exec ? 0755 : 0644);
+        if (fd < 0) {
+            perror(path);
+            exit(1);
+        }
+        close(fd);
+    }
+}
+
+/**
+ * @brief 删除make_entries生成的文件和目录
+ */
+void remove_entries(const char *dir, int count) {
+    char path[PATH_MAX];
+    for (int i = 0; i < count; i++) {
+        snprintf(path, sizeof(path), "%s/cmd%05d", dir, i);
+        if (unlink(path) != 0) rmdir(path);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char *argv[]) {
+    int execs = argc > 1 ? atoi(argv[1]) : COMPLETE_DEFAULT_EXECS;
+    int entries = argc > 2 ? atoi(argv[2]) : COMPLETE_DEFAULT_ENTRIES;
+    char root[] = "/tmp/mybash_complete.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char bin[64], files[64];
+    snprintf(bin, sizeof(bin), "%s/bin", root);
+    snprintf(files, sizeof(files), "%s/files", root);
+    mkdir(bin, 0755);
+    mkdir(files, 0755);
+    make_entries(bin, execs, 1);
+    make_entries(files, entries, 0);
+    var_set("PATH", 4, bin, 1);
+
+    // 前缀树只在第一次Tab时建立
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    trie_refresh();
+    double seconds = seconds_since(&start);
+    int commands = 0;
+    for (int i = 0; i < command_trie.count; i++) commands += command_trie.nodes[i].terminal;
+    report("trie_build", execs, 1, commands, seconds);
+
+    // "cmd1"匹配约十分之一的命令，"cmd0123"只匹配几个
+    const char *prefixes[][2] = {{"wide", "cmd1"}, {"narrow", "cmd0123"}};
+    for (int q = 0; q < 2; q++) {
+        char name[64];
+        Completions comp = {0};
+        long ops = q == 0 ? 200 : 20000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long k = 0; k < ops; k++) {
+            comp = (Completions){0};
+            complete_command(prefixes[q][1], &comp);
+            arena_reset(&line_arena);
+        }
+        snprintf(name, sizeof(name), "command_%s_trie", prefixes[q][0]);
+        report(name, execs, ops, comp.count, seconds_since(&start));
+
+        int matches = 0;
+        ops = 20;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long k = 0; k < ops; k++) {
+            matches = naive_command_matches(bin, prefixes[q][1]);
+        }
+        snprintf(name, sizeof(name), "command_%s_scan", prefixes[q][0]);
+        report(name, execs, ops, matches, seconds_since(&start));
+    }
+
+    // PATH目录中新增一个命令后的第一次Tab：inotify事件触发重建
+    char added[PATH_MAX];
+    snprintf(added, sizeof(added), "%s/zz_new_command", bin);
+    int fd = open(added, O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+    close(fd);
+    Completions comp = {0};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    complete_command("zz_", &comp);
+    report("command_after_change", execs, 1, comp.count, seconds_since(&start));
+    arena_reset(&line_arena);
+    if (comp.count != 1) {
+        fprintf(stderr, "complete_bench: new command not found after inotify event\n");
+        return 1;
+    }
+
+    // 文件名补全：getdents64 + d_type对比readdir + stat
+    char word[PATH_MAX];
+    snprintf(word, sizeof(word), "%s/cmd1", files);
+    long ops = 50;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        comp = (Completions){0};
+        complete_file(word, &comp);
+        arena_reset(&line_arena);
+    }
+    report("file_getdents", entries, ops, comp.count, seconds_since(&start));
+
+    int matches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        matches = naive_file_matches(files, "cmd1");
+    }
+    report("file_readdir_stat", entries, ops, matches, seconds_since(&start));
+
+    unlink(added);
+    remove_entries(bin, execs);
+    remove_entries(files, entries);
+    return rmdir(root) != 0;
+}
@@ -0,0 +1,69 @@
+// shell常驻内存变大时各启动方式的命令速率：fork、spawn和fork服务进程（JSON输出）
+// 用法: bench/fork_bench [次数 [常驻内存MB...]]
+// 先分配并写满指定大小的内存，再用每种launch方式执行若干次/bin/true
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+
+#define FORK_DEFAULT_RUNS 500
+
+/**
+ * @brief 用给定launch方式执行runs次/bin/true，输出一行结果
+ */
+void bench_launch(const char *mode, int runs, int rss_mb) {
+    char line[64];
+    snprintf(line, sizeof(line), "set -o launch=%s", mode);
+    execute_line(line);
+    arena_reset(&line_arena);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < runs; i++) {
+        execute_line("/bin/true");
+        arena_reset(&line_arena);
+        if (last_status != 0) {
+            fprintf(stderr, "fork_bench: /bin/true: exit status %d\n", last_status);
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = elapsed_seconds(&start, &end);
+    printf("{\"bench\":\"launch_rss\",\"shell\":\"mybash02\",\"launch\":\"%s\",\"rss_mb\":%d,"
+           "\"runs\":%d,\"seconds\":%.6f,\"ops_per_sec\":%.0f,\"usec_per_op\":%.1f}\n",
+           mode, rss_mb, runs, seconds, runs / seconds, seconds * 1e6 / runs);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    // fork服务进程执行的是/proc/self/exe，即本程序
+    if (argc == 3 && strcmp(argv[1], "--fork-server") == 0) {
+        return fork_server_main(atoi(argv[2]));
+    }
+    int runs = argc > 1 ? atoi(argv[1]) : FORK_DEFAULT_RUNS;
+    init_jobs(0);
+    init_events();
+
+    int default_sizes[] = {10, 100, 500, 1000};
+    int nsizes = argc > 2 ? argc - 2 : (int)(sizeof(default_sizes) / sizeof(default_sizes[0]));
+    int allocated = 0;
+    for (int i = 0; i < nsizes; i++) {
+        int rss_mb = argc > 2 ? atoi(argv[i + 2]) : default_sizes[i];
+        // 只增不减：每一档补足与上一档的差额
+        if (rss_mb > allocated) {
+            size_t bytes = (size_t)(rss_mb - allocated) << 20;
+            char *block = malloc(bytes);
+            if (!block) {
+                perror("malloc");
+                return 1;
+            }
+            memset(block, 1, bytes);
+            allocated = rss_mb;
+        }
+        bench_launch("fork", runs, rss_mb);
+        bench_launch("spawn", runs, rss_mb);
+        bench_launch("server", runs, rss_mb);
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+// 通配符展开的速度（JSON输出）
+// 用法: bench/glob_bench [目录项数]
+// 在临时目录中生成一个有N项的目录（默认100万）和一棵共N/10项的两层目录树
+// （每个叶子目录至少TREE_MIN_PER_LEAF项，N很小时**仍有东西可测），
+// 对比glob_expand与glibc的glob(3)（**对比nftw + fnmatch，相当于find），
+// 以及编译后的匹配与fnmatch逐个名字匹配的速度。每项先预热一次，取三次中的最好成绩
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+#include "bench.h"
+
+#include <glob.h>
+#include <fnmatch.h>
+#include <ftw.h>
+
+#define GLOB_DEFAULT_ENTRIES 1000000
+#define GLOB_RUNS 3
+#define TREE_FANOUT 32 // 目录树每层的子目录数
+#define TREE_MIN_PER_LEAF 10 // 每个叶子目录的最少文件数
+
+void report(const char *op, const char *impl, int entries, long matches, double seconds) {
+    printf("{\"bench\":\"glob\",\"shell\":\"mybash02\",\"op\":\"%s\",\"impl\":\"%s\",\"entries\":%d,"
+           "\"matches\":%ld,\"seconds\":%.6f}\n", op, impl, entries, matches, seconds);
+    fflush(stdout);
+}
+
+long run_mybash(const char *pattern) {
+    char **paths;
+    long n = glob_expand(pattern, &paths);
+    arena_reset(&line_arena);
+    return n;
+}
+
+long run_glob3(const char *pattern) {
+    glob_t g;
+    long n = glob(pattern, 0, NULL, &g) == 0 ? (long)g.gl_pathc : 0;
+    globfree(&g);
+    return n;
+}
+
+const char *nftw_pattern; // nftw的回调没有参数，用全局变量传递
+long nftw_matches;
+
+int nftw_match(const char *path, const struct stat *sb, int type, struct FTW *ftw) {
+    (void)sb;
+    if (type == FTW_F && fnmatch(nftw_pattern, path + ftw->base, FNM_PERIOD) == 0) {
+        nftw_matches++;
+    }
+    return 0;
+}
+
+long run_nftw(const char *pattern) {
+    // pattern为"目录/**/名字模式"
+    char dir[PATH_MAX];
+    const char *stars = strstr(pattern, "/**/");
+    snprintf(dir, sizeof(dir), "%.*s", (int)(stars - pattern), pattern);
+    nftw_pattern = stars + 4;
+    nftw_matches = 0;
+    nftw(dir, nftw_match, 64, FTW_PHYS);
+    return nftw_matches;
+}
+
+/**
+ * @brief 预热一次后运行GLOB_RUNS次，报告最好成绩
+ */
+void bench_pattern(const char *op, const char *impl, long (*run)(const char *), const char *pattern,
+                   int entries) {
+    long matches = run(pattern);
+    double best = 0;
+    for (int r = 0; r < GLOB_RUNS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        matches = run(pattern);
+        double seconds = seconds_since(&start);
+        if (r == 0 || seconds < best) best = seconds;
+    }
+    report(op, impl, entries, matches, best);
+}
+
+/**
+ * @brief 在dir中生成count个空文件，.log和.txt各一半
+ */
+void make_files(const char *dir, int start, int count) {
+    char name[32];
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (int i = start; i < start + count; i++) {
+        snprintf(name, sizeof(name), "f%07d.%s", i, i % 2 ? "txt" : "log");
+        int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            perror(name);
+            exit(1);
+        }
+        close(fd);
+    }
+    close(dirfd);
+}
+
+void remove_files(const char *dir, int start, int count) {
+    char name[32];
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (int i = start; i < start + count; i++) {
+        snprintf(name, sizeof(name), "f%07d.%s", i, i % 2 ? "txt" : "log");
+        unlinkat(dirfd, name, 0);
+    }
+    close(dirfd);
+    rmdir(dir);
+}
+
+int main(int argc, char *argv[]) {
+    int entries = argc > 1 ? atoi(argv[1]) : GLOB_DEFAULT_ENTRIES;
+    char root[] = "/tmp/mybash_glob.XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (chdir(root) != 0) {
+        perror(root);
+        return 1;
+    }
+    mkdir("flat", 0755);
+    make_files("flat", 0, entries);
+    // 两层目录树，叶子目录中的文件总数为entries/10，但不少于每个叶子TREE_MIN_PER_LEAF个
+    int leaves = TREE_FANOUT * TREE_FANOUT;
+    int per_leaf = entries / 10 / leaves;
+    if (per_leaf < TREE_MIN_PER_LEAF) {
+        per_leaf = TREE_MIN_PER_LEAF;
+    }
+    char dir[64];
+    mkdir("tree", 0755);
+    for (int i = 0; i < leaves; i++) {
+        snprintf(dir, sizeof(dir), "tree/d%02d", i / TREE_FANOUT);
+        mkdir(dir, 0755);
+        snprintf(dir, sizeof(dir), "tree/d%02d/e%02d", i / TREE_FANOUT, i % TREE_FANOUT);
+        mkdir(dir, 0755);
+        make_files(dir, i * per_leaf, per_leaf);
+    }
+
+    // 同一目录中的各种模式：全部、后缀、字符集合、没有匹配（只有扫描的开销）
+    const char *patterns[][2] = {
+        {"all", "flat/*"},
+        {"suffix", "flat/*7.txt"},
+        {"class", "flat/f[0-4]*[13579].txt"},
+        {"none", "flat/*.none"},
+    };
+    for (int i = 0; i < 4; i++) {
+        bench_pattern(patterns[i][0], "mybash02", run_mybash, patterns[i][1], entries);
+        bench_pattern(patterns[i][0], "glob3", run_glob3, patterns[i][1], entries);
+    }
+    bench_pattern("recursive", "mybash02", run_mybash, "tree/**/*7.txt", leaves * per_leaf);
+    bench_pattern("recursive", "nftw_fnmatch", run_nftw, "tree/**/*7.txt", leaves * per_leaf);
+
+    // 只比较匹配本身：编译一次的段对比每个名字调用fnmatch
+    const char *segment = "f[0-4]*[13579].txt";
+    GlobSegment seg;
+    glob_compile_segment(segment, strlen(segment), &seg);
+    char name[32];
+    long matches = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < entries; i++) {
+        int len = snprintf(name, sizeof(name), "f%07d.%s", i, i % 2 ? "txt" : "log");
+        matches += glob_match(&seg, name, len);
+    }
+    report("match", "mybash02", entries, matches, seconds_since(&start));
+    matches = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < entries; i++) {
+        snprintf(name, sizeof(name), "f%07d.%s", i, i % 2 ? "txt" : "log");
+        matches += fnmatch(segment, name, FNM_PERIOD) == 0;
+    }
+    report("match", "fnmatch", entries, matches, seconds_since(&start));
+    arena_reset(&line_arena);
+
+    // 解析一整行：展开后的argv有entries+1项
+    char line[] = "echo flat/*";
+    CommandLine cmdline;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (parse_command(line, &cmdline) != 0 || cmdline.stages[0].argc != entries + 1) {
+        fprintf(stderr, "glob_bench: expanded argv has %d entries\n",
+                cmdline.nstages ? cmdline.stages[0].argc : 0);
+        return 1;
+    }
+    report("parse_argv", "mybash02", entries, cmdline.stages[0].argc, seconds_since(&start));
+    arena_reset(&line_arena);
+
+    remove_files("flat", 0, entries);
+    for (int i = 0; i < leaves; i++) {
+        snprintf(dir, sizeof(dir), "tree/d%02d/e%02d", i / TREE_FANOUT, i % TREE_FANOUT);
+        remove_files(dir, i * per_leaf, per_leaf);
+        if (i % TREE_FANOUT == TREE_FANOUT - 1) {
+            snprintf(dir, sizeof(dir), "tree/d%02d", i / TREE_FANOUT);
+            rmdir(dir);
+        }
+    }
+    rmdir("tree");
+    return rmdir(root) != 0;
+}
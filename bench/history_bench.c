@@ -0,0 +1,135 @@
+// 大历史文件下的历史操作速度（JSON输出）
+// 用法: bench/history_bench [记录数 [并发写入的进程数]]
+// 在临时文件中生成记录，测量首次建立偏移索引、history N定位、!前缀查找、
+// 三元组索引的建立和子串搜索（与逐条memmem对比），以及多个进程同时追加时
+// 的吞吐量并检查没有交错的行
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+#include "bench.h"
+
+#define HISTORY_DEFAULT_ENTRIES 500000
+#define HISTORY_DEFAULT_WRITERS 4
+#define HISTORY_APPENDS 20000 // 每个写入进程追加的记录数
+
+void report(const char *op, int entries, long ops, double seconds) {
+    printf("{\"bench\":\"history\",\"shell\":\"mybash02\",\"op\":\"%s\",\"entries\":%d,"
+           "\"ops\":%ld,\"seconds\":%.6f,\"usec_per_op\":%.2f}\n",
+           op, entries, ops, seconds, seconds * 1e6 / ops);
+    fflush(stdout);
+}
+
+/**
+ * @brief 逐条memmem的子串搜索，作为三元组索引的对照
+ */
+int linear_search(const char *query, int before) {
+    size_t qlen = strlen(query);
+    size_t len;
+    for (int i = before - 1; i >= 0; i--) {
+        const char *text = history_entry(i, &len);
+        if (memmem(text, len, query, qlen)) return i;
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    int entries = argc > 1 ? atoi(argv[1]) : HISTORY_DEFAULT_ENTRIES;
+    int writers = argc > 2 ? atoi(argv[2]) : HISTORY_DEFAULT_WRITERS;
+    char path[] = "/tmp/mybash_history.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    var_set("HISTFILE", 8, path, 0);
+
+    // 类似真实历史的记录：少量命令名加上不同的参数
+    const char *commands[] = {"git status", "make -j8", "ls -la", "cd src/module",
+                              "grep -rn TODO", "vim main.c", "./mybash02 -c", "cat log.txt"};
+    FILE *out = fdopen(fd, "w");
+    for (int i = 0; i < entries; i++) {
+        fprintf(out, "%s arg%d file%d.txt\n", commands[i % 8], i, i % 977);
+    }
+    fclose(out);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (history_sync() != 0 || history.count != entries) {
+        fprintf(stderr, "history_bench: index has %d entries\n", history.count);
+        return 1;
+    }
+    report("load_index", entries, 1, seconds_since(&start));
+
+    // history N：按偏移直接定位最近N条
+    long ops = 100000;
+    size_t total = 0, len;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        int i = history.count - 1 - (int)(k % 20);
+        total += history_entry(i, &len)[0] + len;
+    }
+    report("entry_lookup", entries, ops, seconds_since(&start));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    history_index_trigrams();
+    report("trigram_index", entries, 1, seconds_since(&start));
+
+    // 很少出现的子串（只在最早的记录中）和很常见的子串
+    char rare[32];
+    snprintf(rare, sizeof(rare), "arg%d ", entries / 100);
+    const char *queries[][2] = {{"rare", rare}, {"common", "file1"}};
+    for (int q = 0; q < 2; q++) {
+        char name[64];
+        ops = q == 0 ? 200 : 10000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        // before每次不同，避免循环不变的调用被编译器提出循环
+        for (long k = 0; k < ops; k++) total += history_search(queries[q][1], history.count - (k & 1));
+        snprintf(name, sizeof(name), "search_%s_trigram", queries[q][0]);
+        report(name, entries, ops, seconds_since(&start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long k = 0; k < ops; k++) total += linear_search(queries[q][1], history.count - (k & 1));
+        snprintf(name, sizeof(name), "search_%s_linear", queries[q][0]);
+        report(name, entries, ops, seconds_since(&start));
+    }
+
+    // !前缀：最近的make记录
+    ops = 10000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        char line[] = "!make";
+        total += history_expand(line) != NULL;
+        arena_reset(&line_arena);
+    }
+    report("bang_prefix", entries, ops, seconds_since(&start));
+
+    // 多个进程同时追加，之后检查每一行都完整
+    int before = history.count;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int w = 0; w < writers; w++) {
+        if (fork() == 0) {
+            char line[64];
+            for (int k = 0; k < HISTORY_APPENDS; k++) {
+                snprintf(line, sizeof(line), "writer %d entry %d end", w, k);
+                history_add(line);
+            }
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+    report("concurrent_append", entries, (long)writers * HISTORY_APPENDS, seconds_since(&start));
+    history_sync();
+    int torn = history.count - before != writers * HISTORY_APPENDS;
+    for (int i = before; i < history.count && !torn; i++) {
+        const char *text = history_entry(i, &len);
+        torn = len < 4 || memcmp(text + len - 4, " end", 4) != 0;
+    }
+    unlink(path);
+    if (torn) {
+        fprintf(stderr, "history_bench: concurrent appends produced torn lines\n");
+        return 1;
+    }
+    return total == 0; // 使用计算结果，避免被优化掉
+}
@@ -0,0 +1,76 @@
+// 作业表在大量作业下的操作速度：添加、按ID/进程组/进程查找、删除（JSON输出）
+// 用法: bench/job_bench [作业数...]
+// 作业使用假的pid，不创建子进程
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+
+/**
+ * @brief 输出一项操作的结果
+ */
+void report(const char *op, int njobs, const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = elapsed_seconds(start, &end);
+    printf("{\"bench\":\"job_table\",\"shell\":\"mybash02\",\"op\":\"%s\",\"jobs\":%d,"
+           "\"seconds\":%.6f,\"ops_per_sec\":%.0f}\n", op, njobs, seconds, njobs / seconds);
+}
+
+void bench_jobs(int njobs) {
+    struct timespec start;
+    // 两个进程的管道作业，pid为2i+1000和2i+1001
+    Process procs[2] = {{0}};
+    procs[0].state = procs[1].state = JOB_RUNNING;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < njobs; i++) {
+        procs[0].pid = 2 * i + 1000;
+        procs[1].pid = 2 * i + 1001;
+        if (add_job(procs[0].pid, JOB_RUNNING, "sleep 100 | cat &", 1, procs, 2) == -1) {
+            exit(1);
+        }
+    }
+    report("add", njobs, &start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 1; i <= njobs; i++) {
+        if (!find_job(i)) exit(1);
+    }
+    report("find_by_id", njobs, &start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < njobs; i++) {
+        if (!find_job_by_pgid(2 * i + 1000)) exit(1);
+    }
+    report("find_by_pgid", njobs, &start);
+
+    // 模拟回收：按pid找到进程记录并更新作业状态
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    struct rusage usage = {0};
+    for (int i = 0; i < njobs; i++) {
+        record_child(2 * i + 1000, 0, &usage);
+        record_child(2 * i + 1001, 0, &usage);
+    }
+    report("reap", njobs, &start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    flush_notifications();
+    report("flush_remove", njobs, &start);
+    if (job_count != 0) {
+        fprintf(stderr, "job_bench: %d jobs left\n", job_count);
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        bench_jobs(1000);
+        bench_jobs(10000);
+        bench_jobs(100000);
+    }
+    for (int i = 1; i < argc; i++) {
+        bench_jobs(atoi(argv[i]));
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#!/bin/sh
+# 作业表压力测试：在一个mybash02中启动N个后台作业，再全部回收
+# 用法: bench/job_stress.sh [mybash02程序] [作业数]
+# 检查项：所有作业都进入作业表，结束后作业表为空，没有遗留僵尸进程
+
+SHELL_BIN=${1:-./mybash02}
+N=${2:-10000}
+
+FLOCK=$(command -v flock) || { echo "job_stress: flock not found" >&2; exit 1; }
+TMP=$(mktemp -d /tmp/job_stress.XXXXXX) || exit 1
+mkfifo "$TMP/gate" || exit 1
+
+# 测试开始前先持有排他锁，直到有人打开gate写入端；后台作业等待共享锁，
+# 因此不论启动多慢，所有作业都会存活到jobs列出它们之后
+"$FLOCK" -x "$TMP/lock" sh -c ": > '$TMP/locked'; cat '$TMP/gate' > /dev/null" &
+# 读写方式打开gate不会阻塞，中途失败时也能让持锁进程退出
+trap ': 3<> "$TMP/gate"; rm -rf "$TMP"' EXIT
+while [ ! -e "$TMP/locked" ]; do
+    sleep 0.1
+done
+
+# jobs之后释放锁；再取一次排他锁等作业结束，多等一秒让shell回收
+{
+    i=0
+    while [ "$i" -lt "$N" ]; do
+        echo "$FLOCK -s $TMP/lock /bin/true &"
+        i=$((i + 1))
+    done
+    echo "jobs > $TMP/running"
+    echo "/bin/sh -c ': > $TMP/gate'"
+    echo "$FLOCK -x $TMP/lock /bin/true"
+    echo "/bin/sleep 1"
+    echo "jobs > $TMP/after"
+    echo "/bin/sh -c 'ps -o stat= --ppid \$PPID | grep -c Z' > $TMP/zombies"
+} > "$TMP/script"
+
+start=$(date +%s%N)
+"$SHELL_BIN" "$TMP/script"
+end=$(date +%s%N)
+
+running=$(wc -l < "$TMP/running")
+after=$(wc -l < "$TMP/after")
+zombies=$(cat "$TMP/zombies")
+last_id=$(tail -n 1 "$TMP/running" | sed 's/^\[\([0-9]*\)\].*/\1/')
+echo "jobs=$N listed=$running last_id=$last_id remaining=$after zombies=$zombies elapsed_ms=$(( (end - start) / 1000000 ))"
+
+# shell中途失败时结果文件不存在，按失败处理
+if [ "${running:-0}" -ne "$N" ] || [ "${after:-1}" -ne 0 ] || [ "${zombies:-1}" -ne 0 ]; then
+    echo "FAIL" >&2
+    exit 1
+fi
+echo "OK"
@@ -0,0 +1,64 @@
+// parse_command的吞吐量：对几类合成输入反复解析，输出每秒行数（JSON）
+// 用法: bench/parse_bench [每类输入的行数]
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+
+#define PARSE_DEFAULT_LINES 200000
+
+/**
+ * @brief 生成由nwords个单词组成的长命令行
+ */
+char *make_long_line(int nwords) {
+    char *line = malloc(nwords * 8 + 16);
+    if (!line) {
+        perror("malloc");
+        exit(1);
+    }
+    strcpy(line, "echo");
+    for (int i = 0; i < nwords; i++) {
+        sprintf(line + strlen(line), " arg%d", i);
+    }
+    return line;
+}
+
+/**
+ * @brief 解析同一行lines次，返回每秒行数
+ */
+double parse_rate(const char *line, long lines) {
+    struct timespec start, end;
+    CommandLine cmdline;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < lines; i++) {
+        if (parse_command(line, &cmdline) != 0) {
+            fprintf(stderr, "parse error: %s\n", line);
+            exit(1);
+        }
+        arena_reset(&line_arena);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return lines / elapsed_seconds(&start, &end);
+}
+
+int main(int argc, char *argv[]) {
+    long lines = argc > 1 ? atol(argv[1]) : PARSE_DEFAULT_LINES;
+    struct {
+        const char *name;
+        const char *line;
+    } inputs[] = {
+        {"simple",   "ls -l /tmp"},
+        {"pipeline", "cat access.log | grep -v 'GET /health' | sort | uniq -c | sort -rn > top.txt"},
+        {"quoted",   "printf \"%s\\n\" 'single quoted' \"double \\\"quoted\\\"\" plain\\ escaped >> out.log &"},
+        {"long",     make_long_line(200)},
+    };
+    int ninputs = sizeof(inputs) / sizeof(inputs[0]);
+
+    for (int i = 0; i < ninputs; i++) {
+        double rate = parse_rate(inputs[i].line, lines);
+        printf("{\"bench\":\"parse_rate\",\"shell\":\"mybash02\",\"input\":\"%s\","
+               "\"bytes\":%zu,\"lines\":%ld,\"lines_per_sec\":%.0f}\n",
+               inputs[i].name, strlen(inputs[i].line), lines, rate);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+// 不同管道容量下两阶段管道的吞吐量和上下文切换次数（JSON输出）
+// 用法: bench/pipe_bench 数据文件 [容量...]
+// 容量取值同pipesize关键字：default、adaptive或字节数（可带K、M后缀）
+// 每个容量执行一次 pipesize 容量 /bin/cat 文件 | /bin/cat > /dev/null，
+// 上下文切换次数取自两个子进程的rusage（RUSAGE_CHILDREN的增量）
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+
+/**
+ * @brief 用给定容量执行一次管道，输出一行结果
+ */
+void bench_pipe(const char *data, const char *size) {
+    struct stat st;
+    if (stat(data, &st) != 0) {
+        perror(data);
+        exit(1);
+    }
+    char line[PATH_MAX + 128];
+    snprintf(line, sizeof(line), "pipesize %s /bin/cat %s | /bin/cat > /dev/null", size, data);
+
+    struct rusage before, after;
+    struct timespec start, end;
+    getrusage(RUSAGE_CHILDREN, &before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    execute_line(line);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_CHILDREN, &after);
+    arena_reset(&line_arena);
+    if (last_status != 0) {
+        fprintf(stderr, "pipe_bench: %s: exit status %d\n", line, last_status);
+        exit(1);
+    }
+
+    double seconds = elapsed_seconds(&start, &end);
+    double mb = st.st_size / 1048576.0;
+    long voluntary = after.ru_nvcsw - before.ru_nvcsw;
+    long involuntary = after.ru_nivcsw - before.ru_nivcsw;
+    printf("{\"bench\":\"pipe_size\",\"shell\":\"mybash02\",\"size\":\"%s\",\"mb\":%.0f,"
+           "\"seconds\":%.6f,\"mb_per_sec\":%.1f,\"voluntary_switches\":%ld,"
+           "\"involuntary_switches\":%ld,\"switches_per_mb\":%.1f}\n",
+           size, mb, seconds, mb / seconds, voluntary, involuntary,
+           (voluntary + involuntary) / mb);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s data-file [size...]\n", argv[0]);
+        return EXIT_USAGE;
+    }
+    init_jobs(0);
+    init_events();
+
+    if (argc == 2) {
+        const char *sizes[] = {"default", "16K", "256K", "1M", "adaptive"};
+        for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+            bench_pipe(argv[1], sizes[i]);
+        }
+    }
+    for (int i = 2; i < argc; i++) {
+        bench_pipe(argv[1], argv[i]);
+    }
+    return 0;
+}
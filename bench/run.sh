@@ -0,0 +1,183 @@
+#!/bin/sh
+# 基准测试：三个版本的shell的命令速率、管道吞吐量，以及mybash02的管道容量、cat、启动方式、命令历史、Tab补全、通配符展开、shell变量、命令替换、解析速率和作业表操作
+# 用法: bench/run.sh            （在仓库根目录运行，先make）
+# 每行输出一个JSON对象，整体为 {"results":[...]}；设置BENCH_OUT时另存到该文件
+#
+# 可调参数（环境变量）：
+#   CMD_LINES   每次命令速率测试执行的命令数（默认2000）
+#   PIPE_MB     管道测试的数据量，单位MB（默认256）
+#   CAT_MB      cat吞吐量测试的文件大小，单位MB（默认2048）
+#   PARSE_LINES 每类输入解析的行数（默认200000）
+#   JOB_COUNTS  作业表测试的作业数（默认"1000 10000 100000"）
+#   HISTORY_ENTRIES 命令历史测试的记录数（默认500000）
+#   COMPLETE_EXECS 补全测试中PATH目录的可执行文件数（默认20000）
+#   GLOB_ENTRIES 通配符测试目录的项数（默认1000000）
+#   VAR_COUNT   shell变量测试的导出变量数（默认1000）
+#   SUBST_RUNS  命令替换测试每种方式执行的次数（默认2000）
+#   FORK_RUNS   启动方式测试每档内存执行的命令数（默认500）
+#   RUNS        每项重复次数，取最好成绩（默认3）
+
+CMD_LINES=${CMD_LINES:-2000}
+PIPE_MB=${PIPE_MB:-256}
+CAT_MB=${CAT_MB:-2048}
+PARSE_LINES=${PARSE_LINES:-200000}
+JOB_COUNTS=${JOB_COUNTS:-"1000 10000 100000"}
+FORK_RUNS=${FORK_RUNS:-500}
+HISTORY_ENTRIES=${HISTORY_ENTRIES:-500000}
+COMPLETE_EXECS=${COMPLETE_EXECS:-20000}
+GLOB_ENTRIES=${GLOB_ENTRIES:-1000000}
+VAR_COUNT=${VAR_COUNT:-1000}
+SUBST_RUNS=${SUBST_RUNS:-2000}
+RUNS=${RUNS:-3}
+
+for prog in ./mybash ./mybash01 ./mybash02 bench/parse_bench bench/job_bench bench/pipe_bench bench/fork_bench bench/history_bench bench/complete_bench bench/glob_bench bench/var_bench bench/subst_bench; do
+    if [ ! -x "$prog" ]; then
+        echo "bench/run.sh: $prog not built, run make first" >&2
+        exit 1
+    fi
+done
+
+TMP=$(mktemp -d /tmp/mybash_bench.XXXXXX) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+RESULTS="$TMP/results"
+: > "$RESULTS"
+
+now_ns() {
+    date +%s%N
+}
+
+# 运行"$@"RUNS次，输出最好成绩的纳秒数
+best_ns() {
+    best=
+    run=0
+    while [ "$run" -lt "$RUNS" ]; do
+        start=$(now_ns)
+        "$@"
+        end=$(now_ns)
+        ns=$((end - start))
+        if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+        run=$((run + 1))
+    done
+    echo "$best"
+}
+
+# 把输入脚本喂给shell，输出（包括提示符）丢弃
+run_script() {
+    "$1" < "$2" > /dev/null 2>&1
+}
+
+# ---- 命令速率：每行一条命令，mybash没有PATH查找，统一用绝对路径或内置命令 ----
+cmd_rate() {
+    shell=$1
+    command=$2
+    script="$TMP/cmd_${shell}.sh"
+    i=0
+    while [ "$i" -lt "$CMD_LINES" ]; do
+        echo "$command"
+        i=$((i + 1))
+    done > "$script"
+    echo "exit" >> "$script"
+
+    ns=$(best_ns run_script "./$shell" "$script")
+    awk -v shell="$shell" -v cmd="$command" -v n="$CMD_LINES" -v ns="$ns" 'BEGIN {
+        printf "{\"bench\":\"cmd_rate\",\"shell\":\"%s\",\"command\":\"%s\",\"n\":%d,\"seconds\":%.6f,\"ops_per_sec\":%.0f}\n",
+               shell, cmd, n, ns / 1e9, n / (ns / 1e9)
+    }' >> "$RESULTS"
+}
+
+for shell in mybash mybash01 mybash02; do
+    cmd_rate "$shell" /bin/true
+    # mybash02的pwd是内置命令，其余版本执行/bin/pwd
+    if [ "$shell" = mybash02 ]; then
+        cmd_rate "$shell" pwd
+    else
+        cmd_rate "$shell" /bin/pwd
+    fi
+done
+
+# ---- 管道吞吐量：cat file | cat | ... ，mybash不支持管道 ----
+DATA="$TMP/data"
+dd if=/dev/zero of="$DATA" bs=1M count="$PIPE_MB" 2>/dev/null
+
+for shell in mybash01 mybash02; do
+    for stages in 2 3 4 5; do
+        line="/bin/cat $DATA"
+        i=1
+        while [ "$i" -lt "$stages" ]; do
+            line="$line | /bin/cat"
+            i=$((i + 1))
+        done
+        script="$TMP/pipe_${shell}_${stages}.sh"
+        printf '%s\nexit\n' "$line" > "$script"
+        ns=$(best_ns run_script "./$shell" "$script")
+        awk -v shell="$shell" -v stages="$stages" -v mb="$PIPE_MB" -v ns="$ns" 'BEGIN {
+            printf "{\"bench\":\"pipe_throughput\",\"shell\":\"%s\",\"stages\":%d,\"mb\":%d,\"seconds\":%.6f,\"mb_per_sec\":%.1f}\n",
+                   shell, stages, mb, ns / 1e9, mb / (ns / 1e9)
+        }' >> "$RESULTS"
+    done
+done
+
+# ---- 管道容量：default、16K、256K、1M和adaptive下的吞吐量和上下文切换次数 ----
+bench/pipe_bench "$DATA" >> "$RESULTS"
+
+# ---- cat吞吐量：mybash02的内置cat（零拷贝）与外部的/bin/cat对比 ----
+# file_to_file: cat file > out，内置cat在shell中用copy_file_range
+# file_to_pipe: cat file | /bin/cat > /dev/null，内置cat在子进程中用sendfile
+# pipe_to_file: /bin/cat file | cat > out，内置cat在子进程中用splice
+CAT_DATA="$TMP/cat_data"
+dd if=/dev/zero of="$CAT_DATA" bs=1M count="$CAT_MB" 2>/dev/null
+sync # 生成数据的回写不应计入第一项测试
+
+cat_case() {
+    name=$1
+    impl=$2
+    line=$3
+    script="$TMP/cat_${name}_${impl}.sh"
+    printf '%s\nexit\n' "$line" > "$script"
+    ns=$(best_ns run_script ./mybash02 "$script")
+    rm -f "$TMP/cat_out"
+    awk -v name="$name" -v impl="$impl" -v mb="$CAT_MB" -v ns="$ns" 'BEGIN {
+        printf "{\"bench\":\"cat_throughput\",\"shell\":\"mybash02\",\"case\":\"%s\",\"cat\":\"%s\",\"mb\":%d,\"seconds\":%.6f,\"mb_per_sec\":%.1f}\n",
+               name, impl, mb, ns / 1e9, mb / (ns / 1e9)
+    }' >> "$RESULTS"
+}
+
+for impl in builtin external; do
+    command=cat
+    [ "$impl" = builtin ] || command=/bin/cat
+    cat_case file_to_file "$impl" "$command $CAT_DATA > $TMP/cat_out"
+    cat_case file_to_pipe "$impl" "$command $CAT_DATA | /bin/cat > /dev/null"
+    cat_case pipe_to_file "$impl" "/bin/cat $CAT_DATA | $command > $TMP/cat_out"
+done
+rm -f "$CAT_DATA"
+
+# ---- 启动方式：shell常驻内存为10/100/500/1000MB时fork、spawn和fork服务进程的命令速率 ----
+bench/fork_bench "$FORK_RUNS" >> "$RESULTS"
+
+# ---- 命令历史：偏移索引、!前缀、三元组子串搜索（对比逐条扫描）和并发追加 ----
+bench/history_bench "$HISTORY_ENTRIES" >> "$RESULTS"
+
+# ---- Tab补全：命令名前缀树（对比每次扫描PATH）、inotify触发的重建、getdents64文件名补全 ----
+bench/complete_bench "$COMPLETE_EXECS" >> "$RESULTS"
+
+# ---- 通配符展开：GLOB_ENTRIES项的目录中对比glob(3)，**对比nftw + fnmatch ----
+bench/glob_bench "$GLOB_ENTRIES" >> "$RESULTS"
+
+# ---- shell变量：哈希表查找（对比getenv）、缓存的envp（对比每次重建）、$引用的解析 ----
+bench/var_bench "$VAR_COUNT" >> "$RESULTS"
+
+# ---- 命令替换：进程内捕获的内置命令（对比子shell）、经管道读回的外部命令（对比popen）、管道、大量输出 ----
+bench/subst_bench "$SUBST_RUNS" >> "$RESULTS"
+
+# ---- 解析速率和作业表操作（只有mybash02有对应的函数） ----
+bench/parse_bench "$PARSE_LINES" >> "$RESULTS"
+# shellcheck disable=SC2086
+bench/job_bench $JOB_COUNTS >> "$RESULTS"
+
+{
+    echo '{"results":['
+    sed '$!s/$/,/' "$RESULTS"
+    echo ']}'
+} | if [ -n "$BENCH_OUT" ]; then tee "$BENCH_OUT"; else cat; fi
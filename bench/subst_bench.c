@@ -0,0 +1,112 @@
+// 命令替换的速率（JSON输出）
+// 用法: bench/subst_bench [次数 [输出MB]]
+// 分别测量每种执行方式每秒能完成的替换数：内置命令在shell中写内存缓冲区、
+// 同一内置命令放到fork出的子shell中（没有进程内捕获时的开销）、单条外部命令
+// 经一个管道读回（对比popen，它还要多exec一次/bin/sh）、管道在子shell中执行；
+// 以及读回大量输出时的吞吐量
+
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+#include "bench.h"
+
+#define SUBST_DEFAULT_RUNS 2000
+#define SUBST_DEFAULT_MB 64
+#define SUBST_INPROC_FACTOR 100 // 进程内捕获太快，次数乘以该值
+
+void report(const char *op, const char *command, long ops, size_t bytes, double seconds) {
+    printf("{\"bench\":\"subst\",\"shell\":\"mybash02\",\"op\":\"%s\",\"command\":\"%s\",\"ops\":%ld,"
+           "\"bytes\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,\"usec_per_op\":%.2f}\n",
+           op, command, ops, bytes, seconds, ops / seconds, seconds * 1e6 / ops);
+    fflush(stdout);
+}
+
+/**
+ * @brief 用capture_command执行ops次，检查输出长度
+ */
+void bench_capture(const char *op, const char *command, long ops, size_t expect) {
+    Capture out;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        capture_command(command, &out);
+        free(out.buf);
+        arena_reset(&line_arena);
+        if (out.len != expect || last_status != 0) {
+            fprintf(stderr, "subst_bench: %s: %zu bytes, exit status %d\n", command, out.len,
+                    last_status);
+            exit(1);
+        }
+    }
+    report(op, command, ops, expect, seconds_since(&start));
+}
+
+int main(int argc, char *argv[]) {
+    // fork服务进程执行的是/proc/self/exe，即本程序
+    if (argc == 3 && strcmp(argv[1], "--fork-server") == 0) {
+        return fork_server_main(atoi(argv[2]));
+    }
+    long runs = argc > 1 ? atol(argv[1]) : SUBST_DEFAULT_RUNS;
+    int mb = argc > 2 ? atoi(argv[2]) : SUBST_DEFAULT_MB;
+    init_jobs(0);
+    init_events();
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("getcwd");
+        return 1;
+    }
+
+    // $(pwd)：进程内捕获，对比同一命令在子shell中执行
+    bench_capture("builtin_inproc", "pwd", runs * SUBST_INPROC_FACTOR, strlen(cwd));
+    CommandLine cmdline;
+    Capture out;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < runs; k++) {
+        parse_command("pwd", &cmdline);
+        capture_subshell(&cmdline, &out);
+        free(out.buf);
+        arena_reset(&line_arena);
+    }
+    report("builtin_subshell", "pwd", runs, strlen(cwd), seconds_since(&start));
+
+    // $(/bin/echo x)：spawn + 一个管道，对比popen
+    bench_capture("external_pipe", "/bin/echo x", runs, 1);
+    char buf[64];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < runs; k++) {
+        FILE *p = popen("/bin/echo x", "r");
+        while (p && fread(buf, 1, sizeof(buf), p) > 0) {
+        }
+        if (!p || pclose(p) != 0) {
+            fprintf(stderr, "subst_bench: popen failed\n");
+            return 1;
+        }
+    }
+    report("external_popen", "/bin/echo x", runs, 1, seconds_since(&start));
+
+    // 管道：整条命令在子shell中执行
+    bench_capture("pipeline_subshell", "/bin/echo x | /bin/cat", runs, 1);
+
+    // 大量输出：缓冲区按需加倍
+    char path[] = "/tmp/mybash_subst.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    char *block = calloc(1, 1 << 20);
+    for (int i = 0; i < mb; i++) {
+        if (write(fd, block, 1 << 20) != 1 << 20) {
+            perror("write");
+            return 1;
+        }
+    }
+    close(fd);
+    free(block);
+    char command[64];
+    snprintf(command, sizeof(command), "/bin/cat %s", path);
+    bench_capture("large_output", command, 3, (size_t)mb << 20);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,83 @@
+// shell变量的速度（JSON输出）
+// 用法: bench/var_bench [导出变量数]
+// 在环境中加入N个变量（默认1000），测量哈希表查找（对比getenv逐项扫描environ）、
+// 每次启动命令前取envp（没有变化时直接沿用，对比每次重建），
+// 以及解析含$引用的命令行
+#define main mybash02_main
+#include "../mybash02.c"
+#undef main
+#include "bench.h"
+
+#define VAR_DEFAULT_COUNT 1000
+
+void report(const char *op, int vars_count, long ops, double seconds) {
+    printf("{\"bench\":\"vars\",\"shell\":\"mybash02\",\"op\":\"%s\",\"vars\":%d,"
+           "\"ops\":%ld,\"seconds\":%.6f,\"usec_per_op\":%.3f}\n",
+           op, vars_count, ops, seconds, seconds * 1e6 / ops);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    int count = argc > 1 ? atoi(argv[1]) : VAR_DEFAULT_COUNT;
+    char name[32], value[32];
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+        snprintf(value, sizeof(value), "value%d", i);
+        var_set(name, strlen(name), value, 1);
+    }
+    var_environ();
+
+    // 查找最后加入的两个变量：getenv要扫描整个environ；交替查找，避免调用被提出循环
+    char names[2][32];
+    snprintf(names[0], sizeof(names[0]), "BENCH_VAR_%d", count - 1);
+    snprintf(names[1], sizeof(names[1]), "BENCH_VAR_%d", count - 2);
+    long ops = 200000;
+    size_t total = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        total += strlen(var_get(names[k & 1]));
+    }
+    report("lookup_hash", count, ops, seconds_since(&start));
+
+    ops = 20000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        total += strlen(getenv(names[k & 1]));
+    }
+    report("lookup_getenv", count, ops, seconds_since(&start));
+
+    // 启动命令前取envp：没有导出变量变化时只检查标志
+    ops = 1000000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        total += var_environ() != NULL;
+    }
+    report("envp_cached", count, ops, seconds_since(&start));
+
+    // 每次都有导出变量变化（如A=1 cmd），envp要重建
+    ops = 20000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        snprintf(value, sizeof(value), "%ld", k);
+        var_set("BENCH_CHANGED", 13, value, 1);
+        total += var_environ() != NULL;
+    }
+    report("envp_rebuild", count, ops, seconds_since(&start));
+
+    // 解析含$引用的一行
+    char line[128];
+    snprintf(line, sizeof(line), "echo $BENCH_VAR_0 ${BENCH_VAR_%d}/x \"$BENCH_VAR_1 $?\"", count - 1);
+    CommandLine cmdline;
+    ops = 200000;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long k = 0; k < ops; k++) {
+        if (parse_command(line, &cmdline) != 0 || cmdline.stages[0].argc != 4) {
+            fprintf(stderr, "var_bench: expansion failed\n");
+            return 1;
+        }
+        arena_reset(&line_arena);
+    }
+    report("parse_expand", count, ops, seconds_since(&start));
+    return total == 0; // 使用计算结果，避免被优化掉
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# 递归遍历（ls -R）的线程扩展性测试
+# 用法: bench/walk_scaling.sh [ls程序] [扇出] [深度] [每目录文件数]
+# 在临时目录下生成一棵扇出为FANOUT、深度为DEPTH的目录树，
+# 分别用不同的线程数做无序遍历，每种线程数取3次中的最好成绩，每行输出一个JSON对象
+
+LS=${1:-./mybin/ls}
+FANOUT=${2:-8}
+DEPTH=${3:-4}
+FILES=${4:-32}
+THREADS=${THREADS:-"1 2 4 8"}
+
+TREE=$(mktemp -d /tmp/walk_bench.XXXXXX) || exit 1
+trap 'rm -rf "$TREE"' EXIT
+
+# 用python批量建树，比逐个调用mkdir/touch快得多
+python3 - "$TREE" "$FANOUT" "$DEPTH" "$FILES" <<'PY'
+import os, sys
+root, fanout, depth, files = sys.argv[1], *map(int, sys.argv[2:])
+def build(path, level):
+    for i in range(files):
+        open(os.path.join(path, "f%d.c" % i), "w").close()
+    if level == depth:
+        return
+    for i in range(fanout):
+        sub = os.path.join(path, "d%d" % i)
+        os.mkdir(sub)
+        build(sub, level + 1)
+build(root, 0)
+PY
+
+ENTRIES=$("$LS" -R -U -j 1 "$TREE" | wc -l)
+CPUS=$(nproc)
+
+now_ns() {
+    date +%s%N
+}
+
+for t in $THREADS; do
+    best=
+    for run in 1 2 3; do
+        start=$(now_ns)
+        "$LS" -R -U -j "$t" "$TREE" > /dev/null
+        end=$(now_ns)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "{\"bench\":\"walk_scaling\",\"fanout\":$FANOUT,\"depth\":$DEPTH,\"files\":$FILES,\"entries\":$ENTRIES,\"cpus\":$CPUS,\"threads\":$t,\"best_ms\":$best}"
+done
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
 #define ARG_MAX 10
 #define PATH_BIN "/home/stu/quzijie/bash/mybin/"
 char *get_cmd(char *buff,char* myargv[]){
@@ -46,7 +47,25 @@ void run_cmd(char* path,char* myargv[]){
 		wait(NULL);//处理僵死进程	
 	}
 }
-void printf_info(){
+char prompt_user[512]={0};//"用户名@主机名"部分，启动时查询一次
+char prompt_tail[32]={0};//"$"或"#"
+char prompt[PATH_MAX+1024]={0};//预先格式化好的完整提示符
+int prompt_len=0;
+
+void update_info(){
+	//只在启动和cd成功后重新获取当前目录
+	char dir[PATH_MAX]={0};
+	if(prompt_user[0]=='\0'||getcwd(dir,PATH_MAX)==NULL){
+		prompt_len=snprintf(prompt,sizeof(prompt),"mybash1.0>> ");
+		return ;
+	}
+	prompt_len=snprintf(prompt,sizeof(prompt),"%s%s%s",prompt_user,dir,prompt_tail);
+	if(prompt_len<0||prompt_len>=(int)sizeof(prompt)){
+		prompt_len=snprintf(prompt,sizeof(prompt),"mybash1.0>> ");
+	}
+}
+
+void init_info(){
 	//用户名，主机名，路径，管理员/普通用户
 	char *user_str="$";
 	//存储用户信息位置
@@ -55,30 +74,25 @@ void printf_info(){
 		user_str="#";
 	}
 
+	//getpwuid可能经过NSS，较慢，只在启动时调用一次
 	struct passwd *ptr=getpwuid(user_id);
-	if(ptr==NULL){
-		printf("mybash1.0>> ");
-		fflush(stdout);
-		return ;
-	}
-	
 	char hostname[128]={0};
-	if(gethostname(hostname,128)==-1){
-		printf("mybash1.0>> ");
-		fflush(stdout);
-		return ;
+	if(ptr!=NULL&&gethostname(hostname,127)!=-1){
+		snprintf(prompt_user,sizeof(prompt_user),"\033[1;32m%s@%s\033[0m:\033[1;34m",ptr->pw_name,hostname);
+		snprintf(prompt_tail,sizeof(prompt_tail),"\033[0m%s ",user_str);
 	}
-	
-	char dir[256]={0};
-	if(getcwd(dir,256)==NULL){
-		printf("mybash1.0>> ");
-		fflush(stdout);
+	update_info();
+}
+
+void printf_info(){
+	//先刷出stdio缓冲保证顺序，再用一次write输出整条提示符
+	fflush(stdout);
+	if(write(STDOUT_FILENO,prompt,prompt_len)<0){
 		return ;
 	}
-	printf("\033[1;32m%s@%s\033[0m:\033[1;34m%s\033[0m%s ",ptr->pw_name,hostname,dir,user_str);
-	fflush(stdout);
 }
 int main(){
+	init_info();
 	while(1){
 		//printf("stu@localhost   ~$");
 		printf_info();
@@ -101,6 +115,8 @@ int main(){
 			if(myargv[1]!=NULL){
 				if(chdir(myargv[1])==-1){
 					printf("cd err!");
+				}else{
+					update_info();
 				}
 			}
 		}else if(strcmp(cmd,"exit")==0){
@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
 #include <wait.h>
 #include <pwd.h>
 #include <fcntl.h>  // 新增头文件用于文件操作
@@ -12,37 +13,49 @@
 #define MAX_ARGS_PER_COMMAND 10  // 新增：每命令最大参数数
 #define PATH_BIN "/home/stu/quzijie/bash/mybin/"
 
-void printf_info(){
+char prompt_user[512]={0};//"用户名@主机名"部分，启动时查询一次
+char prompt_tail[32]={0};//"$"或"#"
+char prompt[PATH_MAX+1024]={0};//预先格式化好的完整提示符
+int prompt_len=0;
+
+void update_info(){
+        //只在启动和cd成功后重新获取当前目录
+        char dir[PATH_MAX]={0};
+        if(prompt_user[0]=='\0'||getcwd(dir,PATH_MAX)==NULL){
+                prompt_len=snprintf(prompt,sizeof(prompt),"mybash1.0>> ");
+                return ;
+        }
+        prompt_len=snprintf(prompt,sizeof(prompt),"%s%s%s",prompt_user,dir,prompt_tail);
+        if(prompt_len<0||prompt_len>=(int)sizeof(prompt)){
+                prompt_len=snprintf(prompt,sizeof(prompt),"mybash1.0>> ");
+        }
+}
+
+void init_info(){
         //用户名，主机名，路径，管理员/普通用户
         char *user_str="$";
         //存储用户信息位置
         int user_id=getuid();
         if(user_id==0){
-user_str="#";
+                user_str="#";
         }
 
+        //getpwuid可能经过NSS，较慢，只在启动时调用一次
         struct passwd *ptr=getpwuid(user_id);
-        if(ptr==NULL){
-                printf("mybash1.0>> ");
-                fflush(stdout);
-                return ;
-        }
-
         char hostname[128]={0};
-        if(gethostname(hostname,128)==-1){
-                printf("mybash1.0>> ");
-                fflush(stdout);
-                return ;
+        if(ptr!=NULL&&gethostname(hostname,127)!=-1){
+                snprintf(prompt_user,sizeof(prompt_user),"\033[1;32m%s@%s\033[0m:\033[1;34m",ptr->pw_name,hostname);
+                snprintf(prompt_tail,sizeof(prompt_tail),"\033[0m%s ",user_str);
         }
+        update_info();
+}
 
-        char dir[256]={0};
-        if(getcwd(dir,256)==NULL){
-                printf("mybash1.0>> ");
-                fflush(stdout);
+void printf_info(){
+        //先刷出stdio缓冲保证顺序，再用一次write输出整条提示符
+        fflush(stdout);
+        if(write(STDOUT_FILENO,prompt,prompt_len)<0){
                 return ;
         }
-        printf("\033[1;32m%s@%s\033[0m:\033[1;34m%s\033[0m%s ",ptr->pw_name,hostname,dir,user_str);
-	fflush(stdout);
 }
 
 int parse_command(char *buff, char *commands[][MAX_ARGS_PER_COMMAND], int *in_redirect, int *out_redirect, int *append, char **in_file, char **out_file) {
@@ -197,6 +210,7 @@ void execute_pipeline(char *commands[][MAX_ARGS_PER_COMMAND], int cmd_count) {
 }
 
 int main() {
+    init_info();
     while (1) {
         printf_info();
         char buff[256] = {0};  // 增加缓冲区大小
@@ -212,6 +226,7 @@ int main() {
             char *path = strtok(buff + 2, " ");
             if (path) {
                 if (chdir(path) != 0) perror("cd");
+                else update_info();
             }
             continue;
         } else if (strcmp(buff, "exit") == 0) {
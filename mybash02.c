@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -11,12 +12,67 @@
 #include <sys/types.h>
 #include <termios.h>
 #include <errno.h>
+#include <spawn.h>
+#include <limits.h>
+#include <sys/signalfd.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/pidfd.h>
+#include <poll.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <ctype.h>
 
-#define ARG_MAX 10
-#define MAX_COMMANDS 5
-#define MAX_ARGS_PER_COMMAND 10
-#define MAX_JOBS 20
+// mybin中的工具编译为内置命令，同一份源码仍可单独编译为可执行文件
+#define MYBASH_BUILTIN
+#include "mybin/pwd.c"
+#include "mybin/clear.c"
+#include "mybin/ls.c"
+#include "mybin/cat.c"
+
+#include "serve.h"
+
+#define JOB_INDEX_BUCKETS 64  // 作业索引的初始桶数（2的幂，按需倍增）
+#define STAT_SUB_BITS 3       // 直方图每个2的幂区间再细分为2^3个桶（误差不超过12.5%）
+#define STAT_BUCKETS (64 << STAT_SUB_BITS)
+#define TRACE_EVENTS 4096     // 追踪事件环形缓冲区大小
+#define TRACE_LINES 256       // 保留命令文本的行数（shellstat -t最多导出的命令数）
+#define TRACE_TEXT 64         // 每行保留的命令文本长度
+#define PIPE_SAMPLE_MS 50     // 自适应管道容量的采样间隔（毫秒）
+#define PIPE_GROW_SWITCHES 50 // 一个采样间隔内两端主动让出CPU的次数达到该值时扩大管道
+#define AFFINITY_TEXT 64      // affinity选项中CPU列表文本的最大长度
+#define SERVER_MAX_FDS 64     // 一次启动请求最多传递的描述符数（SCM_RIGHTS）
+#define HISTORY_FILE ".mybash02_history" // 主目录下的默认历史文件（可用HISTFILE指定）
+#define TRIGRAM_BUCKETS 4096  // 历史三元组索引的初始桶数（2的幂，按需倍增）
+#define DENTS_BUF_SIZE 32768  // 补全时每次getdents64读取的字节数
+// ioprio_set没有glibc封装，常量与内核linux/ioprio.h一致
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << 13) | (data))
 #define PATH_BIN "/home/stu/quzijie/bash/mybin/"
+#define HASH_BUCKETS 64       // 命令路径哈希表桶数
+#define VAR_BUCKETS 64        // 变量表的初始槽数（2的幂，按需倍增）
+#define CAPTURE_INITIAL_SIZE 4096 // 读取命令替换输出的初始缓冲区大小（按需加倍）
+#define EXIT_NOT_FOUND 127    // 命令无法执行时的退出码
+#define EXIT_USAGE 2          // 语法或用法错误的退出码
+#define READ_BLOCK_SIZE 65536 // 非交互模式每次读取的字节数
+#define ARENA_CHUNK_SIZE 65536 // 内存池每块的默认大小
+
+// glibc 2.35起posix_spawn可以在子进程中设置终端前台进程组
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
 
 typedef enum {
     JOB_RUNNING,
@@ -25,827 +81,6826 @@ typedef enum {
 } JobStatus;
 
 typedef struct {
+    pid_t pid;              // 进程ID
+    JobStatus state;        // 进程状态
+    int status;             // 最近一次wait4得到的状态
+    struct rusage usage;    // 结束或暂停时wait4得到的资源使用情况
+    struct timespec start;  // 启动时间（CLOCK_MONOTONIC）
+    struct timespec end;    // 结束时间
+} Process;
+
+typedef struct Job {
     int id;           // 作业ID
     pid_t pgid;       // 进程组ID
-    JobStatus status; // 作业状态
+    JobStatus status; // 作业状态，由各进程的状态汇总得到
     char *command;    // 命令字符串
     int is_pipeline;  // 是否为管道命令
+    Process *procs;   // 作业中的各个进程（按管道顺序）
+    int nprocs;
+    int notify;       // 状态变化尚未报告给用户
+    struct Job *prev; // 作业列表中的前一个作业（按ID递增）
+    struct Job *next; // 作业列表中的后一个作业
 } Job;
 
+typedef struct JobIndexEntry {
+    int key;                    // 作业ID、进程组ID或进程ID
+    Job *job;                   // 对应的作业
+    Process *proc;              // 按进程ID索引时对应的进程记录
+    struct JobIndexEntry *next; // 同一个桶中的下一项
+} JobIndexEntry;
+
+typedef struct {
+    JobIndexEntry **buckets;    // 桶数组，首次插入时分配
+    int nbuckets;               // 桶数（2的幂）
+    int count;                  // 表项数
+} JobIndex;
+
+typedef struct HashEntry {
+    char *name;             // 命令名
+    char *path;             // 解析得到的完整路径
+    int hits;               // 命中次数
+    struct HashEntry *next; // 同一个桶中的下一项
+} HashEntry;
+
+typedef enum {
+    FD_DUP2,          // 复制描述符
+    FD_CLOSE          // 关闭描述符
+} FdActionType;
+
+typedef struct {
+    FdActionType type;
+    int fd;           // 目标文件描述符
+    int src;          // FD_DUP2: 源文件描述符
+} FdAction;
+
+typedef int (*BuiltinFunc)(int argc, char **argv);
+
+typedef enum {
+    AFFINITY_INHERIT, // 继承shell的CPU亲和性
+    AFFINITY_SPREAD,  // 每个阶段绑定到一个CPU，依次轮换
+    AFFINITY_NUMA,    // 每个阶段绑定到一个NUMA节点的全部CPU，依次轮换
+    AFFINITY_LIST     // 全部阶段限制在给定的CPU列表中
+} AffinityMode;
+
+typedef enum {
+    SCHED_CLASS_NORMAL, // 继承shell的调度策略和I/O优先级
+    SCHED_CLASS_BATCH,  // SCHED_BATCH，I/O优先级为尽力而为类的最低级
+    SCHED_CLASS_IDLE    // SCHED_IDLE，I/O优先级为idle类
+} SchedClass;
+
+typedef struct {
+    const char *path;  // 已解析的可执行文件路径
+    BuiltinFunc func;  // 非NULL时在fork出的子进程中调用它代替exec
+    cpu_set_t *cpus;   // 非NULL时子进程在exec前绑定到这些CPU
+    SchedClass sched;  // 子进程在exec前切换到的调度类
+    char **argv;       // 参数列表
+    pid_t pgid;        // 要加入的进程组，0表示新建进程组，-1表示留在shell的进程组
+    int foreground;    // 是否设置为终端前台进程组
+    FdAction *actions; // 子进程中依次执行的描述符操作（分配在内存池中）
+    int nactions;
+    int action_cap;
+} LaunchSpec;
+
+// 发给fork服务进程的启动请求头，随后是path、argv、envp各字符串（以'\0'结尾）。
+// 描述符随请求头以SCM_RIGHTS传递，依次为：当前目录、shell的标准输入输出
+// （stdio中对应位为1的）、各FD_DUP2操作的源描述符。
+typedef struct {
+    uint32_t len;         // 字符串数据的字节数
+    int32_t nargs;        // argv中的字符串数
+    int32_t nenv;         // envp中的字符串数
+    int32_t pgid;         // 同LaunchSpec，但-1已换成发送方的进程组ID
+    int32_t foreground;
+    int32_t interactive;  // shell是否交互式运行（决定子进程是否取得终端）
+    int32_t sched;
+    int32_t has_cpus;
+    cpu_set_t cpus;
+    int32_t stdio;        // 随请求传递的shell标准描述符（第i位对应描述符i）
+    int32_t nactions;
+    struct {
+        int32_t type;
+        int32_t fd;
+    } actions[SERVER_MAX_FDS];
+} ServerRequest;
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next; // 下一块
+    size_t size;             // data的字节数
+    char data[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head;    // 第一块
+    ArenaChunk *current; // 当前分配所在的块
+    size_t used;         // 当前块已使用的字节数
+} Arena;
+
+typedef enum {
+    TOK_WORD,         // 普通单词
+    TOK_PIPE,         // |
+    TOK_AMP,          // &
+    TOK_LESS,         // <
+    TOK_GREAT,        // >
+    TOK_DGREAT,       // >>
+    TOK_LESSAND,      // <&
+    TOK_GREATAND      // >&
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    char *text;       // TOK_WORD的内容，运算符为NULL
+    char *pattern;    // 含未加引号的*、?、[时为通配符模式（加引号的字符用\转义），否则为NULL
+    int fd;           // 重定向运算符前的描述符编号（如2>中的2），没有时为-1
+    int assign;       // 以未加引号的"名字="开头，在命令名之前时是变量赋值
+} Token;
+
+typedef enum {
+    REDIR_FILE,       // N>file、N>>file、N<file
+    REDIR_DUP,        // N>&M、N<&M
+    REDIR_CLOSE       // N>&-、N<&-
+} RedirectType;
+
+typedef struct Redirect {
+    RedirectType type;
+    int fd;                // 被重定向的描述符
+    int flags;             // REDIR_FILE: open标志
+    const char *path;      // REDIR_FILE: 目标文件
+    int src;               // REDIR_DUP: 源描述符
+    int opened;            // REDIR_FILE: 执行前在shell中打开的描述符，未打开时为-1
+    struct Redirect *next; // 下一条重定向（按出现顺序）
+} Redirect;
+
+typedef struct {
+    char **argv;          // 以NULL结尾的参数列表
+    int argc;
+    Redirect *redirects;  // 本阶段的重定向
+    char **assigns;       // 命令名之前的"名字=值"
+    int nassigns;
+} Stage;
+
+typedef enum {
+    READER_PRIVATE,       // 只有shell读取该描述符，按块读取
+    READER_SEEKABLE,      // 与命令共享且可定位：启动命令前把读取位置退回到已执行的行末
+    READER_BYTEWISE       // 与命令共享且不可定位（管道）：每次只读一个字节，不多读
+} ReaderMode;
+
+typedef struct {
+    int fd;               // 输入描述符，-1表示数据全部在内存中
+    ReaderMode mode;
+    char *buf;            // 缓冲区
+    size_t cap;           // 缓冲区容量
+    size_t start;         // 未处理数据的起点
+    size_t end;           // 未处理数据的终点
+    int eof;              // 是否已读到文件末尾
+} LineReader;
+
+typedef struct {
+    Stage *stages;        // 管道中的各个阶段
+    int nstages;
+    int background;       // 是否以&结尾
+    int timed;            // 是否以time关键字开头
+    int pipe_size;        // pipesize关键字指定的管道容量，-1表示使用pipesize选项
+    int affinity;         // cpus关键字指定的AffinityMode，-1表示使用affinity选项
+    cpu_set_t *cpus;      // cpus关键字给出的CPU列表（AFFINITY_LIST）
+    int sched;            // sched关键字指定的SchedClass，-1表示按bgsched选项
+    const char *text;     // 原始命令文本
+    struct timespec time_start;  // time的计时起点（有命令替换时从解析之前算起）
+    struct rusage time_before;   // 计时起点时shell自身的资源用量
+} CommandLine;
+
+typedef enum {
+    LAUNCH_FORK,      // fork + exec
+    LAUNCH_SPAWN,     // posix_spawn（vfork语义，不复制页表）
+    LAUNCH_SERVER     // 由启动时exec出的小型fork服务进程代为创建
+} LaunchMode;
+
+typedef enum {
+    BUILTIN_SHELL,    // 在shell进程中执行
+    BUILTIN_SUBSHELL, // 在子进程中作为普通作业运行（可以后台执行、被Ctrl+Z暂停）
+    BUILTIN_FILTER,   // 输出重定向到文件时在shell中执行，否则同BUILTIN_SUBSHELL
+    BUILTIN_WALK      // ls：带-R时同BUILTIN_SUBSHELL（遍历可能很久，要能被Ctrl+C/Ctrl+Z中断），否则在shell中执行
+} BuiltinPlace;
+
+typedef struct {
+    const char *name;  // 命令名
+    BuiltinFunc func;  // 实现函数，返回退出状态
+    BuiltinPlace place;
+    int capture;       // 命令替换中直接在shell中执行（只向stdout输出，不改变shell的状态）
+} Builtin;
+
+typedef enum {
+    STAT_LINE,        // 整行命令（从解析到执行结束）
+    STAT_PARSE,       // 词法和语法分析
+    STAT_LOOKUP,      // 命令路径查找
+    STAT_FORK,        // fork调用
+    STAT_SPAWN,       // posix_spawn调用（vfork语义，返回时子进程已exec）
+    STAT_SERVER,      // fork服务进程的一次请求往返
+    STAT_SETPGID,     // 父进程中的setpgid
+    STAT_TCSETPGRP,   // 父进程中转移终端前台进程组
+    STAT_WAIT,        // 等待前台作业
+    STAT_BUILTIN,     // 执行内置命令
+    NUM_STATS
+} StatPhase;
+
+typedef struct {
+    unsigned int buckets[STAT_BUCKETS]; // 按纳秒数的对数-线性分桶计数
+    unsigned long count;
+    unsigned long long max;             // 最大值（纳秒）
+} Histogram;
+
+typedef struct {
+    StatPhase phase;
+    unsigned long line;                 // 所属命令的序号
+    unsigned long long start;           // 开始时间（纳秒，CLOCK_MONOTONIC）
+    unsigned long long dur;             // 持续时间（纳秒）
+} TraceEvent;
+
+typedef struct {
+    const char *name;           // 选项名
+    int *value;                 // 当前取值（choices下标）
+    const char *const *choices; // 可选值，以NULL结尾
+    int (*parse)(const char *text, int *value); // 非NULL时取值由它解析，超出choices的取值按数字显示
+    const char *(*format)(int value);           // 非NULL时由它显示取值
+} ShellOption;
+
+typedef enum {
+    PIPE_SIZE_DEFAULT,  // 使用内核默认容量
+    PIPE_SIZE_ADAPTIVE  // 从默认容量开始，阶段频繁阻塞时逐步扩大
+} PipeSizeMode;         // pipesize的特殊取值，其余取值为字节数
+
+typedef struct {
+    pid_t writer;           // 写端所在阶段的进程
+    pid_t reader;           // 读端所在阶段的进程
+    ino_t ino;              // 管道的inode，用于确认从子进程取到的描述符
+    int size;               // 当前容量
+    unsigned long switches; // 上次采样时两端进程的主动上下文切换次数之和
+    int fixed;              // 已达上限或无法调整，不再采样
+} PipeState;
+
+typedef struct {
+    PipeState *pipes;       // 各阶段之间的管道
+    int npipes;
+    int max_size;           // /proc/sys/fs/pipe-max-size
+    struct timespec last;   // 上次采样的时间
+} PipeMonitor;
+
+typedef struct {
+    uint32_t key;           // 三个字节拼成的键，0表示空桶（含'\0'的三元组不会出现）
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *entries;      // 包含该三元组的记录序号，递增
+} TrigramList;
+
+typedef struct {
+    int fd;                 // 历史文件（O_APPEND），-1表示尚未打开
+    char *map;              // 文件的只读映射
+    size_t mapped;          // 映射长度
+    size_t indexed;         // 已建立索引的字节数（总在行尾）
+    uint32_t *offsets;      // 每条记录的起始偏移
+    int count;              // 已索引的记录数
+    int cap;
+    TrigramList *trigrams;  // 三元组 -> 记录序号（开放寻址）
+    int trigram_mask;       // 桶数-1，0表示未建立
+    int trigram_used;
+    int trigram_count;      // 已加入三元组索引的记录数
+} History;
+
+typedef struct {
+    char *buf;              // 正在编辑的行
+    size_t len;
+    size_t pos;             // 光标位置（字节）
+    size_t cap;
+    char in[256];           // 已从终端读入、尚未处理的字节（粘贴的内容）
+    int in_start;
+    int in_end;
+} LineEditor;
+
+typedef struct {
+    unsigned char c;        // 到达该节点的字符
+    int child;              // 第一个子节点，0表示没有
+    int sibling;            // 下一个兄弟节点（按字符递增），0表示没有
+    int terminal;           // 根到该节点是一个完整的命令名
+} TrieNode;
+
+typedef struct {
+    TrieNode *nodes;        // 节点0为根
+    int count;
+    int cap;
+    int inotify_fd;         // 监视PATH各目录，-1表示尚未建立
+    unsigned long path_version; // 建树时PATH的版本（vars.path_version）
+} CommandTrie;
+
+typedef struct {
+    char **items;           // 候选项（分配在line_arena中）
+    int count;
+    int cap;
+} Completions;
+
+typedef enum {
+    PAT_LITERAL,            // 固定文本
+    PAT_ANY,                // ?
+    PAT_CLASS,              // [...]
+    PAT_STAR                // *
+} GlobOpType;
+
+typedef struct {
+    GlobOpType type;
+    int width;              // 匹配的字节数（*为0）
+    const char *text;       // PAT_LITERAL：文本
+    const uint8_t *set;     // PAT_CLASS：256位的字符集合（已处理取反）
+} GlobOp;
+
+typedef struct {
+    GlobOp *ops;
+    int nops;
+    const char *literal;    // 不含通配符的段：去掉转义后的名字，否则为NULL
+    int recursive;          // 整段为**
+    int dot;                // 以.开头，可以匹配隐藏文件
+} GlobSegment;
+
+typedef struct {
+    GlobSegment *segs;      // 按/分开的各段
+    int nsegs;
+    int absolute;           // 以/开头
+    int dir_only;           // 以/结尾，只匹配目录
+} GlobPattern;
+
+typedef struct {
+    const GlobPattern *pat;
+    char **paths;           // 匹配的路径（分配在line_arena中）
+    int count;
+    int cap;
+    char path[PATH_MAX];    // 当前目录的前缀（以/结尾或为空）
+    size_t path_len;
+    char *dents;            // getdents64缓冲区，目录读完后才进入子目录，共用一个
+} GlobState;
+
+typedef struct {
+    char **names;           // 读完目录后要进入的子目录
+    int *segs;              // 在各子目录中匹配的段
+    int count;
+    int cap;
+} GlobQueue;
+
+typedef struct {
+    uint64_t key;           // 共同前缀之后的8个字节（大端，不足补0）
+    char *path;
+} GlobSortItem;
+
+typedef struct Capture {
+    char *buf;              // 命令替换的输出（malloc分配，展开后释放）
+    size_t len;
+    struct Capture *next;   // 同一行中的下一个替换（按出现顺序）
+} Capture;
+
+typedef struct {
+    char *name;             // 变量名（表中只保存一份），NULL表示空槽
+    uint32_t hash;
+    char *entry;            // "名字=值"，可以直接放进envp；NULL表示未设置
+    int exported;
+} ShellVar;
+
+typedef struct {
+    ShellVar *slots;        // 开放寻址，unset后名字仍留在槽中
+    int mask;               // 槽数-1
+    int used;               // 有名字的槽数
+    char **envp;            // 导出变量的"名字=值"，以NULL结尾，同时作为environ
+    int envp_cap;
+    int envp_dirty;         // 导出变量有变化，下次启动命令前重建envp
+    char **retired;         // 旧envp仍引用的"名字=值"，重建后释放
+    int nretired, retired_cap;
+    unsigned long path_version; // PATH的值每变化一次加1
+} VarTable;
+
 // 全局变量
-Job jobs[MAX_JOBS];             // 作业列表
-int current_job_id = 1;         // 下一个可用的作业ID
+Job *job_head = NULL;           // 作业列表（按ID递增的双向链表）
+Job *job_tail = NULL;           // 最近添加的作业
+int job_count = 0;              // 作业列表中的作业数
+JobIndex jobs_by_id;            // 作业ID -> 作业
+JobIndex jobs_by_pgid;          // 进程组ID -> 作业
+JobIndex jobs_by_pid;           // 进程ID -> 作业和进程记录
+int *notify_queue = NULL;       // 等待报告状态变化的作业ID
+int notify_len = 0;
+int notify_cap = 0;
+Job *foreground_job = NULL;     // 正在等待的前台作业
+PipeMonitor *pipe_monitor = NULL; // 前台管道的自适应容量状态，等待时定期采样
+int sigchld_fd = -1;            // 接收SIGCHLD的signalfd
+int epoll_fd = -1;              // 主循环的epoll实例
+int input_fd = -1;              // 已加入epoll的输入描述符
+int input_pollable = 0;         // 输入描述符能否用epoll等待（普通文件不能）
+LineReader *shared_input = NULL; // 从标准输入读取的脚本，命令可能接着读取剩余输入
 pid_t shell_pgid;               // shell进程组ID
 int shell_is_interactive;       // shell是否交互式运行
+HashEntry *hash_table[HASH_BUCKETS]; // 命令路径哈希表
+char *hash_path_env = NULL;     // 建表时的PATH快照，PATH变化后整表失效
+unsigned long hash_path_version = -1; // 建表时PATH的版本（vars.path_version）
+VarTable vars;                  // shell变量（首次访问时从environ导入）
+int launch_mode = LAUNCH_SPAWN; // 进程启动方式
+int server_fd = -1;             // 与fork服务进程通信的socket，-1表示未启动
+History history = {.fd = -1};   // 命令历史（交互模式下记录，首次使用时才映射和建索引）
+int hash_learn_fd = -1;         // --serve会话中报告新缓存命令名的管道，-1表示不报告
+pid_t *serve_sessions = NULL;   // --serve：客户端连接描述符 -> 会话进程（0表示空闲）
+int serve_sessions_cap = 0;
+struct termios shell_tmodes;    // 启动时的终端设置，每行命令执行前恢复
+int editor_enabled = 0;         // 是否使用行编辑器（交互模式且终端不是dumb）
+LineEditor editor;              // 行编辑器状态
+CommandTrie command_trie = {.inotify_fd = -1}; // 命令名补全的前缀树（首次按Tab时建立）
+char prompt_user[512];          // 提示符前缀（用户名@主机名），启动时生成
+char prompt_tail[32];           // 提示符后缀（$或#）
+char prompt_buf[PATH_MAX + 1024]; // 预先格式化好的完整提示符
+size_t prompt_len;              // 提示符长度
+Arena line_arena;               // 每行命令使用的内存池，执行完后整体重置
+int last_status = 0;            // 最近一条前台命令的退出状态
+int stats_enabled = 0;          // 是否记录延迟统计（set -o stats=on）
+int pipe_size_mode = PIPE_SIZE_DEFAULT; // 管道容量（set -o pipesize=default|adaptive|字节数）
+int affinity_mode = AFFINITY_INHERIT; // 子进程的CPU亲和性（set -o affinity=...）
+cpu_set_t affinity_cpus;        // affinity为CPU列表时的CPU集合
+char affinity_text[AFFINITY_TEXT]; // affinity为CPU列表时的原始文本
+unsigned int spread_next = 0;   // spread/numa下一个阶段使用的CPU或节点序号
+int bg_sched = SCHED_CLASS_NORMAL; // 后台作业的调度类（set -o bgsched=...）
+Histogram stat_hist[NUM_STATS]; // 各阶段的延迟直方图
+TraceEvent trace_events[TRACE_EVENTS]; // 最近的追踪事件（环形缓冲区）
+unsigned long trace_next = 0;   // 下一个追踪事件的序号
+unsigned long trace_line = 0;   // 当前命令的序号
+char trace_text[TRACE_LINES][TRACE_TEXT]; // 最近各行的命令文本
+
+const char *const launch_choices[] = {"fork", "spawn", "server", NULL};
+const char *const switch_choices[] = {"off", "on", NULL};
+const char *const pipe_size_choices[] = {"default", "adaptive", NULL};
+const char *const affinity_choices[] = {"inherit", "spread", "numa", NULL};
+const char *const sched_choices[] = {"normal", "batch", "idle", NULL};
+
+int parse_pipe_size(const char *text, int *value);
+int parse_affinity_option(const char *text, int *value);
+const char *format_affinity(int value);
+
+ShellOption shell_options[] = {
+    {"launch", &launch_mode, launch_choices},
+    {"stats",  &stats_enabled, switch_choices},
+    {"pipesize", &pipe_size_mode, pipe_size_choices, parse_pipe_size},
+    {"affinity", &affinity_mode, affinity_choices, parse_affinity_option, format_affinity},
+    {"bgsched", &bg_sched, sched_choices},
+};
+#define NUM_OPTIONS (int)(sizeof(shell_options) / sizeof(shell_options[0]))
+
+// 函数声明
+void refresh_prompt();
+void restore_redirects(const Stage *stage, int *saved, int n);
+void close_redirect_files(Stage *stage);
+void reader_init_fd(LineReader *reader, int fd);
+char *reader_next_line(LineReader *reader);
+void reader_sync(LineReader *reader);
+char *editor_read_line();
+void capture_command(const char *line, Capture *out);
 
 /**********************************************************************
- * 作业管理函数
+ * 内存池
  **********************************************************************/
 
 /**
- * @brief 初始化作业列表和shell环境
+ * @brief 从内存池分配内存（按8字节对齐）
+ *
+ * 块在重置后保留复用，稳定运行时每行命令不再调用malloc。
  */
-void init_jobs() {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        jobs[i].id = -1;
-        jobs[i].command = NULL;
-    }
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
     
-    // 设置shell进程组
-    shell_pgid = getpgrp();
-    shell_is_interactive = isatty(STDIN_FILENO);
+    ArenaChunk *chunk = arena->current;
+    if (chunk && arena->used + size <= chunk->size) {
+        void *ptr = chunk->data + arena->used;
+        arena->used += size;
+        return ptr;
+    }
     
-    if (shell_is_interactive) {
-        // 确保shell在前台
-        while (tcgetpgrp(STDIN_FILENO) != shell_pgid) {
-            kill(-shell_pgid, SIGTTIN);
+    // 当前块不够用：优先复用后面已有的块，否则新建一块插在当前块之后
+    ArenaChunk *next = chunk ? chunk->next : arena->head;
+    if (!next || next->size < size) {
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+        ArenaChunk *fresh = malloc(sizeof(ArenaChunk) + chunk_size);
+        if (!fresh) {
+            perror("malloc");
+            exit(1);
         }
-        
-        // 忽略作业控制信号
-        signal(SIGINT, SIG_IGN);
-        signal(SIGQUIT, SIG_IGN);
-        signal(SIGTSTP, SIG_IGN);
-        signal(SIGTTIN, SIG_IGN);
-        signal(SIGTTOU, SIG_IGN);
+        fresh->size = chunk_size;
+        fresh->next = next;
+        if (chunk) {
+            chunk->next = fresh;
+        } else {
+            arena->head = fresh;
+        }
+        next = fresh;
     }
+    
+    arena->current = next;
+    arena->used = size;
+    return next->data;
 }
 
 /**
- * @brief 添加新作业到列表
+ * @brief 重置内存池，O(1)，所有块留待下次复用
  */
-int add_job(pid_t pgid, JobStatus status, const char *command, int is_pipeline) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].id == -1) {
-            jobs[i].id = current_job_id++;
-            jobs[i].pgid = pgid;
-            jobs[i].status = status;
-            jobs[i].command = strdup(command);
-            jobs[i].is_pipeline = is_pipeline;
-            if (!jobs[i].command) {
-                jobs[i].id = -1;
-                return -1;
-            }
-            return jobs[i].id;
-        }
-    }
-    return -1;
+void arena_reset(Arena *arena) {
+    arena->current = NULL;
+    arena->used = 0;
 }
 
 /**
- * @brief 根据ID查找作业
+ * @brief 在内存池中复制字符串
  */
-Job* find_job(int id) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].id == id) {
-            return &jobs[i];
-        }
-    }
-    return NULL;
+char *arena_strdup(Arena *arena, const char *str) {
+    size_t len = strlen(str) + 1;
+    return memcpy(arena_alloc(arena, len), str, len);
 }
 
+/**********************************************************************
+ * shell变量
+ *
+ * 变量保存在开放寻址（线性探测）的哈希表中，每个名字在表中只保存一份，
+ * unset只清除值，名字留在原来的槽中，因此不需要删除标记。每个变量的值
+ * 以"名字=值"的形式保存，可以直接放进envp。导出变量的envp数组缓存起来
+ * 并作为environ，只有导出变量变化后才在下一次启动命令前重建，
+ * posix_spawn、fork服务进程和execve直接使用它。
+ * 第一次访问时从启动时的environ导入全部变量（均为导出变量）。
+ **********************************************************************/
+
 /**
- * @brief 根据进程组ID查找作业
+ * @brief 变量名的哈希值（FNV-1a）
  */
-Job* find_job_by_pgid(pid_t pgid) {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].id != -1 && jobs[i].pgid == pgid) {
-            return &jobs[i];
-        }
+uint32_t var_hash(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
     }
-    return NULL;
+    return h;
 }
 
 /**
- * @brief 更新作业状态
+ * @brief 判断是否是合法的变量名：字母或下划线开头，由字母、数字和下划线组成
  */
-void update_job_status(pid_t pgid, JobStatus status) {
-    Job* job = find_job_by_pgid(pgid);
-    if (job) {
-        job->status = status;
-        // 作业完成时释放资源
-        if (status == JOB_DONE) {
-            printf("[%d]+\tDone\t\t%s\n", job->id, job->command);
-            free(job->command);
-            job->command = NULL;
-            job->id = -1;
-        }
+int var_name_valid(const char *name, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        return 0;
     }
+    for (size_t i = 1; i < len; i++) {
+        if (!(isalnum((unsigned char)name[i]) || name[i] == '_')) return 0;
+    }
+    return 1;
 }
 
+void var_import(char **env);
+
 /**
- * @brief 清理已完成的作业
+ * @brief 查找变量所在的槽
+ * @param create 不存在时是否加入名字
+ * @return 槽，不存在且不创建时返回NULL
  */
-void cleanup_jobs() {
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].id != -1 && jobs[i].status == JOB_DONE) {
-            free(jobs[i].command);
-            jobs[i].command = NULL;
-            jobs[i].id = -1;
+ShellVar *var_slot(const char *name, size_t len, int create) {
+    if (!vars.slots) {
+        vars.mask = VAR_BUCKETS - 1;
+        vars.slots = calloc(VAR_BUCKETS, sizeof(ShellVar));
+        if (!vars.slots) {
+            perror("calloc");
+            exit(1);
+        }
+        vars.envp_dirty = 1;
+        var_import(environ);
+    }
+    uint32_t h = var_hash(name, len);
+    for (uint32_t i = h & vars.mask;; i = (i + 1) & vars.mask) {
+        ShellVar *var = &vars.slots[i];
+        if (!var->name) {
+            break;
         }
+        if (var->hash == h && strncmp(var->name, name, len) == 0 && var->name[len] == '\0') {
+            return var;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    
+    // 负载超过3/4时槽数加倍，重新插入所有名字
+    if ((vars.used + 1) * 4 > (vars.mask + 1) * 3) {
+        int old_count = vars.mask + 1;
+        ShellVar *old = vars.slots;
+        vars.mask = old_count * 2 - 1;
+        vars.slots = calloc(old_count * 2, sizeof(ShellVar));
+        if (!vars.slots) {
+            perror("calloc");
+            exit(1);
+        }
+        for (int k = 0; k < old_count; k++) {
+            if (!old[k].name) continue;
+            uint32_t i = old[k].hash & vars.mask;
+            while (vars.slots[i].name) i = (i + 1) & vars.mask;
+            vars.slots[i] = old[k];
+        }
+        free(old);
+    }
+    uint32_t i = h & vars.mask;
+    while (vars.slots[i].name) i = (i + 1) & vars.mask;
+    ShellVar *var = &vars.slots[i];
+    var->name = strndup(name, len);
+    if (!var->name) {
+        perror("strndup");
+        exit(1);
     }
+    var->hash = h;
+    var->entry = NULL;
+    var->exported = 0;
+    vars.used++;
+    return var;
 }
 
-/**********************************************************************
- * 信号处理函数
- **********************************************************************/
+/**
+ * @brief 取变量的值
+ * @return 值，未设置时返回NULL
+ */
+const char *var_get_n(const char *name, size_t len) {
+    ShellVar *var = var_slot(name, len, 0);
+    return var && var->entry ? var->entry + len + 1 : NULL;
+}
+
+const char *var_get(const char *name) {
+    return var_get_n(name, strlen(name));
+}
 
 /**
- * @brief SIGCHLD信号处理程序
+ * @brief 设置变量
+ * @param value 新的值，NULL表示unset
+ * @param exported 1导出，0取消导出，-1保持原来的导出状态
  */
-void handle_sigchld(int sig) {
-    int status;
-    pid_t pid;
-    
-    // 处理所有状态变化的子进程
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
-        // 获取进程组ID
-        pid_t pgid = getpgid(pid);
-        if (pgid == -1) {
-            // 如果getpgid失败，可能进程已经终止，尝试用pid作为pgid
-            pgid = pid;
+void var_set(const char *name, size_t len, const char *value, int exported) {
+    ShellVar *var = var_slot(name, len, 1);
+    int was_exported = var->exported && var->entry;
+    const char *old = var->entry ? var->entry + len + 1 : NULL;
+    int changed = (old == NULL) != (value == NULL) || (old && strcmp(old, value) != 0);
+    if (changed) {
+        if (len == 4 && memcmp(name, "PATH", 4) == 0) {
+            vars.path_version++; // 命令路径缓存和补全前缀树据此失效
         }
-        
-        if (WIFEXITED(status) || WIFSIGNALED(status)) {
-            // 进程正常退出或被信号终止
-            update_job_status(pgid, JOB_DONE);
-        } else if (WIFSTOPPED(status)) {
-            // 进程被信号停止
-            update_job_status(pgid, JOB_STOPPED);
-            Job* job = find_job_by_pgid(pgid);
-            if (job) {
-                printf("\n[%d]+\tStopped\t\t%s\n", job->id, job->command);
+        if (was_exported) {
+            // environ可能还指向它，等下次重建envp后再释放
+            if (vars.nretired == vars.retired_cap) {
+                vars.retired_cap = vars.retired_cap ? vars.retired_cap * 2 : 16;
+                vars.retired = realloc(vars.retired, vars.retired_cap * sizeof(char *));
+                if (!vars.retired) {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            vars.retired[vars.nretired++] = var->entry;
+        } else {
+            free(var->entry);
+        }
+        var->entry = NULL;
+        if (value) {
+            size_t vlen = strlen(value);
+            var->entry = malloc(len + vlen + 2);
+            if (!var->entry) {
+                perror("malloc");
+                exit(1);
             }
-        } else if (WIFCONTINUED(status)) {
-            // 进程被继续执行
-            update_job_status(pgid, JOB_RUNNING);
+            memcpy(var->entry, name, len);
+            var->entry[len] = '=';
+            memcpy(var->entry + len + 1, value, vlen + 1);
         }
     }
+    if (exported >= 0) {
+        var->exported = exported;
+    }
+    if ((changed && (was_exported || var->exported)) || was_exported != (var->exported && var->entry)) {
+        vars.envp_dirty = 1;
+    }
 }
 
-/**********************************************************************
- * 内置命令实现
- **********************************************************************/
-
 /**
- * @brief 打印作业列表
+ * @brief 导入"名字=值"数组中的变量，全部标为导出
  */
-void cmd_jobs() {
-    cleanup_jobs(); // 清理已完成的作业
-    
-    for (int i = 0; i < MAX_JOBS; i++) {
-        if (jobs[i].id != -1) {
-            printf("[%d]\t", jobs[i].id);
-            switch (jobs[i].status) {
-                case JOB_RUNNING: printf("Running"); break;
-                case JOB_STOPPED: printf("Stopped"); break;
-                case JOB_DONE: printf("Done"); break;
-            }
-            printf("\t\t%s\n", jobs[i].command);
+void var_import(char **env) {
+    for (; env && *env; env++) {
+        const char *eq = strchr(*env, '=');
+        if (eq && eq > *env) {
+            var_set(*env, eq - *env, eq + 1, 1);
         }
     }
 }
 
 /**
- * @brief 将后台作业切换到前台运行
+ * @brief 清除所有变量的值（--serve会话改用客户端的环境变量时）
  */
-void cmd_fg(int job_id) {
-    Job *job = NULL;
-    
-    // 如果没有指定job_id，使用最近的作业
-    if (job_id == -1) {
-        int max_id = 0;
-        for (int i = 0; i < MAX_JOBS; i++) {
-            if (jobs[i].id != -1 && jobs[i].id > max_id) {
-                max_id = jobs[i].id;
-                job = &jobs[i];
-            }
+void var_clear() {
+    var_slot("", 0, 0); // 保证已初始化
+    for (int i = 0; i <= vars.mask; i++) {
+        if (vars.slots[i].name && vars.slots[i].entry) {
+            var_set(vars.slots[i].name, strlen(vars.slots[i].name), NULL, 0);
         }
-    } else {
-        job = find_job(job_id);
     }
-    
-    if (!job) {
-        printf("fg: %d: no such job\n", job_id);
-        return;
+}
+
+/**
+ * @brief 取得导出变量的envp，有变化时重建，并设为environ
+ *
+ * 启动每个命令前调用；没有变化时只检查一次标志。
+ */
+char **var_environ() {
+    var_slot("", 0, 0);
+    if (!vars.envp_dirty) {
+        return vars.envp;
     }
-    
-    // 更新作业状态
-    job->status = JOB_RUNNING;
-    
-    if (shell_is_interactive) {
-        // 设置前台进程组
-        tcsetpgrp(STDIN_FILENO, job->pgid);
+    int n = 0;
+    for (int i = 0; i <= vars.mask; i++) {
+        n += vars.slots[i].exported && vars.slots[i].entry;
     }
-    
-    // 发送SIGCONT信号继续运行作业
-    kill(-job->pgid, SIGCONT);
-    
-    // 等待作业完成或暂停
-    int status;
-    pid_t result = waitpid(-job->pgid, &status, WUNTRACED);
-    
-    if (shell_is_interactive) {
-        // 重新获取终端控制权
-        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    if (n + 1 > vars.envp_cap) {
+        char **envp = realloc(vars.envp, (n + 1) * sizeof(char *));
+        if (!envp) {
+            perror("realloc");
+            exit(1);
+        }
+        vars.envp = envp;
+        vars.envp_cap = n + 1;
     }
-    
-    // 检查作业状态
-    if (result > 0) {
-        if (WIFEXITED(status) || WIFSIGNALED(status)) {
-            update_job_status(job->pgid, JOB_DONE);
-        } else if (WIFSTOPPED(status)) {
-            update_job_status(job->pgid, JOB_STOPPED);
+    n = 0;
+    for (int i = 0; i <= vars.mask; i++) {
+        if (vars.slots[i].exported && vars.slots[i].entry) {
+            vars.envp[n++] = vars.slots[i].entry;
         }
     }
+    vars.envp[n] = NULL;
+    vars.envp_dirty = 0;
+    environ = vars.envp;
+    for (int i = 0; i < vars.nretired; i++) free(vars.retired[i]);
+    vars.nretired = 0;
+    return vars.envp;
 }
 
 /**
- * @brief 将暂停的作业切换到后台运行
+ * @brief 处理"名字=值"形式的赋值单词
+ * @return 是赋值时返回1
  */
-void cmd_bg(int job_id) {
-    Job *job = NULL;
-    
-    // 如果没有指定job_id，使用最近的暂停作业
-    if (job_id == -1) {
-        int max_id = 0;
-        for (int i = 0; i < MAX_JOBS; i++) {
-            if (jobs[i].id != -1 && jobs[i].status == JOB_STOPPED && jobs[i].id > max_id) {
-                max_id = jobs[i].id;
-                job = &jobs[i];
-            }
-        }
-    } else {
-        job = find_job(job_id);
-    }
-    
-    if (!job) {
-        printf("bg: %d: no such job\n", job_id);
-        return;
-    }
-    
-    if (job->status != JOB_STOPPED) {
-        printf("bg: job %d already in background\n", job_id);
-        return;
+int var_assign(const char *word, int exported) {
+    const char *eq = strchr(word, '=');
+    if (!eq || !var_name_valid(word, eq - word)) {
+        return 0;
     }
-    
-    // 更新作业状态
-    job->status = JOB_RUNNING;
-    
-    // 发送SIGCONT信号继续运行作业
-    kill(-job->pgid, SIGCONT);
-    printf("[%d]+\tContinued\t%s\n", job_id, job->command);
+    var_set(word, eq - word, eq + 1, exported);
+    return 1;
 }
 
 /**
- * @brief 执行cd命令
+ * @brief 展开p处的$引用：$名字、${名字}、$?、$$
+ * @param out 不为NULL时写入展开的值
+ * @param len 值的长度
+ * @return 引用之后的位置；$后面不是引用时原样输出$，返回p+1；
+ *         ${缺少}或名字不合法时报告错误并返回NULL
  */
-void cmd_cd(const char *path) {
-    if (!path || strcmp(path, "") == 0) {
-        // 默认切换到HOME目录
-        const char *home = getenv("HOME");
-        if (!home) {
-            fprintf(stderr, "cd: HOME not set\n");
-            return;
+const char *expand_dollar(const char *p, char *out, size_t *len) {
+    char number[16];
+    const char *value = NULL;
+    const char *end;
+    if (p[1] == '?' || p[1] == '$') {
+        snprintf(number, sizeof(number), "%d", p[1] == '?' ? last_status : (int)getpid());
+        value = number;
+        end = p + 2;
+    } else if (p[1] == '{') {
+        const char *close = strchr(p + 2, '}');
+        if (!close || !var_name_valid(p + 2, close - p - 2)) {
+            fprintf(stderr, "mybash: %.*s: bad substitution\n",
+                    close ? (int)(close - p + 1) : (int)strlen(p), p);
+            return NULL;
         }
-        path = home;
-    }
-    
-    if (chdir(path) != 0) {
-        perror("cd");
+        value = var_get_n(p + 2, close - p - 2);
+        end = close + 1;
+    } else if (isalpha((unsigned char)p[1]) || p[1] == '_') {
+        end = p + 2;
+        while (isalnum((unsigned char)*end) || *end == '_') end++;
+        value = var_get_n(p + 1, end - p - 1);
+    } else {
+        // 单独的$
+        if (out) *out = '$';
+        *len = 1;
+        return p + 1;
     }
+    *len = value ? strlen(value) : 0;
+    if (out && value) memcpy(out, value, *len);
+    return end;
 }
 
+/**********************************************************************
+ * 延迟统计
+ *
+ * 热路径上的各个阶段用CLOCK_MONOTONIC计时，记录到固定分桶的直方图中，
+ * 同时写入追踪事件环形缓冲区，可以导出为Chrome trace-event JSON。
+ * 关闭时stat_now和stat_record只检查一次开关，不读时钟。
+ **********************************************************************/
+
+const char *const stat_names[NUM_STATS] = {
+    "line", "parse", "lookup", "fork", "spawn", "server", "setpgid", "tcsetpgrp", "wait",
+    "builtin"
+};
+
 /**
- * @brief 处理内置命令
+ * @brief 读取单调时钟（纳秒），统计关闭时返回0
  */
-int handle_builtin_commands(char *buff, char *original_cmd) {
-    // 创建一个buff的副本进行操作，避免修改原始buff
-    char *temp_buff = strdup(buff);
-    if (!temp_buff) {
-        perror("strdup");
+static inline unsigned long long stat_now() {
+    if (!stats_enabled) {
         return 0;
     }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 计算纳秒数所在的桶：小于8直接作下标，其余按最高位所在的
+ * 2的幂区间分组，区间内再按接下来的STAT_SUB_BITS位细分
+ */
+int stat_bucket(unsigned long long ns) {
+    if (ns < (1 << STAT_SUB_BITS)) {
+        return ns;
+    }
+    int order = 63 - __builtin_clzll(ns);
+    int sub = (ns >> (order - STAT_SUB_BITS)) & ((1 << STAT_SUB_BITS) - 1);
+    return ((order - STAT_SUB_BITS + 1) << STAT_SUB_BITS) | sub;
+}
+
+/**
+ * @brief 桶的上界（纳秒）
+ */
+unsigned long long stat_bucket_limit(int bucket) {
+    if (bucket < (1 << STAT_SUB_BITS)) {
+        return bucket;
+    }
+    int order = (bucket >> STAT_SUB_BITS) + STAT_SUB_BITS - 1;
+    unsigned long long sub = bucket & ((1 << STAT_SUB_BITS) - 1);
+    return (((1ULL << STAT_SUB_BITS) + sub + 1) << (order - STAT_SUB_BITS)) - 1;
+}
+
+/**
+ * @brief 记录一个阶段从start到现在的耗时
+ */
+static inline void stat_record(StatPhase phase, unsigned long long start) {
+    if (!stats_enabled || start == 0) {
+        return;
+    }
+    unsigned long long dur = stat_now() - start;
+    Histogram *hist = &stat_hist[phase];
+    hist->buckets[stat_bucket(dur)]++;
+    hist->count++;
+    if (dur > hist->max) {
+        hist->max = dur;
+    }
+    
+    TraceEvent *event = &trace_events[trace_next++ % TRACE_EVENTS];
+    event->phase = phase;
+    event->line = trace_line;
+    event->start = start;
+    event->dur = dur;
+}
+
+/**
+ * @brief 开始统计新的一行命令，保存命令文本用于追踪导出
+ */
+void stat_begin_line(const char *line) {
+    if (!stats_enabled) {
+        return;
+    }
+    trace_line++;
+    char *text = trace_text[trace_line % TRACE_LINES];
+    strncpy(text, line, TRACE_TEXT - 1);
+    text[TRACE_TEXT - 1] = '\0';
+}
+
+/**
+ * @brief 直方图的分位数（纳秒，取桶的上界且不超过最大值）
+ */
+unsigned long long stat_percentile(const Histogram *hist, double p) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    unsigned long rank = (unsigned long)(p * hist->count);
+    if (rank < 1) rank = 1;
+    unsigned long seen = 0;
+    for (int i = 0; i < STAT_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            unsigned long long limit = stat_bucket_limit(i);
+            return limit < hist->max ? limit : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+/**
+ * @brief 以JSON字符串的形式输出文本
+ */
+void json_write_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief 把最近nlines行命令的追踪事件导出为Chrome trace-event JSON
+ */
+int stat_dump_trace(const char *path, unsigned long nlines) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return 1;
+    }
+    if (nlines > TRACE_LINES) nlines = TRACE_LINES;
+    unsigned long first_line = trace_line >= nlines ? trace_line - nlines + 1 : 1;
+    unsigned long first = trace_next > TRACE_EVENTS ? trace_next - TRACE_EVENTS : 0;
+    int pid = getpid();
+    
+    fprintf(out, "{\"traceEvents\":[");
+    int n = 0;
+    for (unsigned long i = first; i < trace_next; i++) {
+        TraceEvent *event = &trace_events[i % TRACE_EVENTS];
+        if (event->line < first_line) {
+            continue;
+        }
+        fprintf(out, "%s\n{\"name\":", n++ ? "," : "");
+        // 整行事件以命令文本命名，其余以阶段命名
+        if (event->phase == STAT_LINE) {
+            json_write_string(out, trace_text[event->line % TRACE_LINES]);
+        } else {
+            json_write_string(out, stat_names[event->phase]);
+        }
+        fprintf(out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":%d,\"tid\":1,\"args\":{\"line\":%lu}}",
+                stat_names[event->phase], event->start / 1e3, event->dur / 1e3,
+                pid, event->line);
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(out);
+    return 0;
+}
+
+/**********************************************************************
+ * 作业管理函数
+ **********************************************************************/
+
+/**
+ * @brief 初始化作业列表和shell环境
+ *
+ * 非交互模式（脚本、-c）下不检查终端前台进程组，也不忽略作业控制信号。
+ */
+void init_jobs(int interactive) {
+    // 设置shell进程组
+    shell_pgid = getpgrp();
+    shell_is_interactive = interactive;
+    
+    if (shell_is_interactive) {
+        // 确保shell在前台
+        while (tcgetpgrp(STDIN_FILENO) != shell_pgid) {
+            kill(-shell_pgid, SIGTTIN);
+        }
+        
+        // 忽略作业控制信号
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+    }
+}
+
+/**
+ * @brief 计算索引中键所在的桶
+ */
+int job_index_slot(const JobIndex *index, int key) {
+    return ((unsigned int)key * 2654435761u) & (index->nbuckets - 1);
+}
+
+/**
+ * @brief 向索引中插入一项，表项数超过桶数时桶数倍增
+ */
+void job_index_insert(JobIndex *index, int key, Job *job, Process *proc) {
+    if (index->count >= index->nbuckets) {
+        int old_nbuckets = index->nbuckets;
+        JobIndexEntry **old_buckets = index->buckets;
+        index->nbuckets = old_nbuckets ? old_nbuckets * 2 : JOB_INDEX_BUCKETS;
+        index->buckets = calloc(index->nbuckets, sizeof(JobIndexEntry *));
+        if (!index->buckets) {
+            perror("calloc");
+            exit(1);
+        }
+        for (int i = 0; i < old_nbuckets; i++) {
+            JobIndexEntry *entry = old_buckets[i];
+            while (entry) {
+                JobIndexEntry *next = entry->next;
+                int slot = job_index_slot(index, entry->key);
+                entry->next = index->buckets[slot];
+                index->buckets[slot] = entry;
+                entry = next;
+            }
+        }
+        free(old_buckets);
+    }
+    
+    JobIndexEntry *entry = malloc(sizeof(JobIndexEntry));
+    if (!entry) {
+        perror("malloc");
+        exit(1);
+    }
+    int slot = job_index_slot(index, key);
+    entry->key = key;
+    entry->job = job;
+    entry->proc = proc;
+    entry->next = index->buckets[slot];
+    index->buckets[slot] = entry;
+    index->count++;
+}
+
+/**
+ * @brief 在索引中查找键
+ */
+JobIndexEntry *job_index_find(const JobIndex *index, int key) {
+    if (index->count == 0) {
+        return NULL;
+    }
+    for (JobIndexEntry *entry = index->buckets[job_index_slot(index, key)];
+         entry; entry = entry->next) {
+        if (entry->key == key) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 从索引中删除属于指定作业的键
+ */
+void job_index_remove(JobIndex *index, int key, const Job *job) {
+    if (index->count == 0) {
+        return;
+    }
+    JobIndexEntry **link = &index->buckets[job_index_slot(index, key)];
+    while (*link) {
+        JobIndexEntry *entry = *link;
+        if (entry->key == key && entry->job == job) {
+            *link = entry->next;
+            free(entry);
+            index->count--;
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+/**
+ * @brief 添加新作业到列表，进程记录复制到作业中
+ *
+ * 作业ID为当前最大ID加1，作业列表清空后从1重新开始。
+ */
+int add_job(pid_t pgid, JobStatus status, const char *command, int is_pipeline,
+            const Process *procs, int nprocs) {
+    Job *job = calloc(1, sizeof(Job));
+    if (job) {
+        job->command = strdup(command);
+        job->procs = malloc(nprocs * sizeof(Process));
+    }
+    if (!job || !job->command || !job->procs) {
+        perror("add_job");
+        if (job) {
+            free(job->command);
+            free(job->procs);
+            free(job);
+        }
+        return -1;
+    }
+    job->id = job_tail ? job_tail->id + 1 : 1;
+    job->pgid = pgid;
+    job->status = status;
+    job->is_pipeline = is_pipeline;
+    memcpy(job->procs, procs, nprocs * sizeof(Process));
+    job->nprocs = nprocs;
+    
+    job->prev = job_tail;
+    if (job_tail) {
+        job_tail->next = job;
+    } else {
+        job_head = job;
+    }
+    job_tail = job;
+    job_count++;
+    
+    job_index_insert(&jobs_by_id, job->id, job, NULL);
+    job_index_insert(&jobs_by_pgid, pgid, job, NULL);
+    for (int i = 0; i < nprocs; i++) {
+        job_index_insert(&jobs_by_pid, procs[i].pid, job, &job->procs[i]);
+    }
+    return job->id;
+}
+
+/**
+ * @brief 从作业列表中删除作业并释放资源
+ */
+void remove_job(Job *job) {
+    job_index_remove(&jobs_by_id, job->id, job);
+    job_index_remove(&jobs_by_pgid, job->pgid, job);
+    for (int i = 0; i < job->nprocs; i++) {
+        job_index_remove(&jobs_by_pid, job->procs[i].pid, job);
+    }
+    
+    if (job->prev) {
+        job->prev->next = job->next;
+    } else {
+        job_head = job->next;
+    }
+    if (job->next) {
+        job->next->prev = job->prev;
+    } else {
+        job_tail = job->prev;
+    }
+    job_count--;
+    
+    free(job->command);
+    free(job->procs);
+    free(job);
+}
+
+/**
+ * @brief 根据ID查找作业
+ */
+Job* find_job(int id) {
+    JobIndexEntry *entry = job_index_find(&jobs_by_id, id);
+    return entry ? entry->job : NULL;
+}
+
+/**
+ * @brief 根据进程组ID查找作业
+ */
+Job* find_job_by_pgid(pid_t pgid) {
+    JobIndexEntry *entry = job_index_find(&jobs_by_pgid, pgid);
+    return entry ? entry->job : NULL;
+}
+
+/**
+ * @brief 根据进程ID查找所属作业（包括正在等待的前台作业）
+ *
+ * 前台作业不一定在作业列表中，它的进程不多，直接逐个比较。
+ */
+Job *find_job_by_pid(pid_t pid, Process **proc) {
+    if (foreground_job) {
+        for (int i = 0; i < foreground_job->nprocs; i++) {
+            if (foreground_job->procs[i].pid == pid) {
+                *proc = &foreground_job->procs[i];
+                return foreground_job;
+            }
+        }
+    }
+    JobIndexEntry *entry = job_index_find(&jobs_by_pid, pid);
+    if (!entry) {
+        return NULL;
+    }
+    *proc = entry->proc;
+    return entry->job;
+}
+
+/**
+ * @brief 由各进程的状态汇总作业状态
+ *
+ * 全部结束为DONE；其余未结束的进程都已暂停为STOPPED；否则为RUNNING。
+ */
+void job_refresh_status(Job *job) {
+    int done = 0, stopped = 0;
+    for (int i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == JOB_DONE) done++;
+        else if (job->procs[i].state == JOB_STOPPED) stopped++;
+    }
+    if (done == job->nprocs) {
+        job->status = JOB_DONE;
+    } else if (stopped > 0 && done + stopped == job->nprocs) {
+        job->status = JOB_STOPPED;
+    } else {
+        job->status = JOB_RUNNING;
+    }
+}
+
+/**
+ * @brief 把作业中暂停的进程标记为运行（发送SIGCONT前调用）
+ */
+void job_mark_running(Job *job) {
+    for (int i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == JOB_STOPPED) {
+            job->procs[i].state = JOB_RUNNING;
+        }
+    }
+    job->status = JOB_RUNNING;
+    job->notify = 0;
+}
+
+/**
+ * @brief 清理已完成的作业
+ */
+void cleanup_jobs() {
+    Job *job = job_head;
+    while (job) {
+        Job *next = job->next;
+        if (job->status == JOB_DONE) {
+            remove_job(job);
+        }
+        job = next;
+    }
+}
+
+/**
+ * @brief 把wait4得到的状态转换为shell退出状态
+ */
+int exit_status(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status)) return 128 + WSTOPSIG(status);
+    return 0;
+}
+
+/**
+ * @brief 作业的退出状态：有进程暂停时取暂停信号，否则取最后一个进程
+ */
+int job_exit_status(const Job *job) {
+    for (int i = 0; i < job->nprocs; i++) {
+        if (job->procs[i].state == JOB_STOPPED) {
+            return exit_status(job->procs[i].status);
+        }
+    }
+    return exit_status(job->procs[job->nprocs - 1].status);
+}
+
+/**********************************************************************
+ * 管道容量
+ *
+ * 默认64KB的管道在大流量管道中每写满一次就要切换一次进程。
+ * pipesize选项或关键字在创建管道时用F_SETPIPE_SZ设置固定容量；
+ * adaptive模式下shell等待前台管道时每PIPE_SAMPLE_MS毫秒读取一次
+ * 各阶段的主动上下文切换次数，两端频繁阻塞的管道容量翻倍，
+ * 直到/proc/sys/fs/pipe-max-size。shell不持有管道描述符（否则会
+ * 影响EOF和EPIPE），调整时用pidfd_getfd从子进程临时取一份。
+ **********************************************************************/
+
+/**
+ * @brief 解析管道容量：default、adaptive或字节数（可带K、M后缀）
+ * @return 成功返回0，格式错误返回-1
+ */
+int parse_pipe_size(const char *text, int *value) {
+    if (strcmp(text, "default") == 0) {
+        *value = PIPE_SIZE_DEFAULT;
+        return 0;
+    }
+    if (strcmp(text, "adaptive") == 0) {
+        *value = PIPE_SIZE_ADAPTIVE;
+        return 0;
+    }
+    char *end;
+    long size = strtol(text, &end, 10);
+    if (end == text || size <= 0) return -1;
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+        end++;
+    }
+    // 先检查范围再移位，避免大数溢出（strtol溢出时返回LONG_MAX，同样超出范围）
+    if (*end != '\0' || size > (1L << 30) >> shift) return -1;
+    size <<= shift;
+    // 内核按页向上取整，小于一页的值也就是一页，同时避开特殊取值
+    long page = sysconf(_SC_PAGESIZE);
+    *value = size < page ? page : size;
+    return 0;
+}
+
+/**
+ * @brief 设置新建管道的固定容量，失败只警告，管道仍可使用
+ */
+void pipe_apply_size(int fd, int size) {
+    if (size > PIPE_SIZE_ADAPTIVE && fcntl(fd, F_SETPIPE_SZ, size) == -1) {
+        fprintf(stderr, "mybash: pipesize %d: %s\n", size, strerror(errno));
+    }
+}
+
+/**
+ * @brief 读取管道容量上限（非特权进程不能超过它）
+ */
+int pipe_max_size() {
+    static int max_size = 0;
+    if (max_size == 0) {
+        FILE *fp = fopen("/proc/sys/fs/pipe-max-size", "re");
+        if (!fp || fscanf(fp, "%d", &max_size) != 1 || max_size <= 0) {
+            max_size = 1 << 20;
+        }
+        if (fp) fclose(fp);
+    }
+    return max_size;
+}
+
+/**
+ * @brief 创建自适应管道的状态，各管道的进程和inode由调用者填写
+ */
+PipeMonitor *pipe_monitor_new(int npipes) {
+    PipeMonitor *monitor = arena_alloc(&line_arena, sizeof(PipeMonitor));
+    monitor->pipes = arena_alloc(&line_arena, (npipes + 1) * sizeof(PipeState));
+    memset(monitor->pipes, 0, (npipes + 1) * sizeof(PipeState));
+    monitor->npipes = npipes;
+    monitor->max_size = pipe_max_size();
+    clock_gettime(CLOCK_MONOTONIC, &monitor->last);
+    return monitor;
+}
+
+/**
+ * @brief 进程累计的主动上下文切换次数（阻塞在管道等资源上），读取失败返回0
+ */
+unsigned long proc_voluntary_switches(pid_t pid) {
+    char path[64], buf[2048];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    // 前面的换行用来排除nonvoluntary_ctxt_switches
+    char *field = strstr(buf, "\nvoluntary_ctxt_switches:");
+    return field ? strtoul(field + 26, NULL, 10) : 0;
+}
+
+/**
+ * @brief 从子进程取得它的描述符fd的副本，必须是inode为ino的管道
+ * @return 描述符（带FD_CLOEXEC），失败返回-1
+ */
+int pipe_fd_from(pid_t pid, int fd, ino_t ino) {
+    if (pid <= 0) return -1;
+    int pidfd = pidfd_open(pid, 0);
+    if (pidfd < 0) return -1;
+    int copy = pidfd_getfd(pidfd, fd, 0);
+    close(pidfd);
+    struct stat st;
+    if (copy >= 0 && (fstat(copy, &st) != 0 || !S_ISFIFO(st.st_mode) || st.st_ino != ino)) {
+        close(copy); // 阶段把这个描述符重定向到了别处
+        copy = -1;
+    }
+    return copy;
+}
+
+/**
+ * @brief 把管道容量翻倍（不超过上限），从读端或写端进程取得管道描述符
+ */
+void pipe_grow(PipeMonitor *monitor, PipeState *pipe_state) {
+    int fd = pipe_fd_from(pipe_state->reader, STDIN_FILENO, pipe_state->ino);
+    if (fd < 0) {
+        fd = pipe_fd_from(pipe_state->writer, STDOUT_FILENO, pipe_state->ino);
+    }
+    if (fd < 0) {
+        pipe_state->fixed = 1;
+        return;
+    }
+    int size = pipe_state->size * 2;
+    if (size > monitor->max_size) size = monitor->max_size;
+    int got = fcntl(fd, F_SETPIPE_SZ, size);
+    close(fd);
+    if (got < 0) {
+        pipe_state->fixed = 1; // 如超出pipe-user-pages-soft
+        return;
+    }
+    pipe_state->size = got;
+    if (got >= monitor->max_size) {
+        pipe_state->fixed = 1;
+    }
+}
+
+/**
+ * @brief 距上次采样超过PIPE_SAMPLE_MS时检查各管道两端的阻塞情况
+ */
+void pipe_monitor_sample(PipeMonitor *monitor) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - monitor->last.tv_sec) * 1000 +
+              (now.tv_nsec - monitor->last.tv_nsec) / 1000000;
+    if (ms < PIPE_SAMPLE_MS) return;
+    monitor->last = now;
+    
+    for (int i = 0; i < monitor->npipes; i++) {
+        PipeState *pipe_state = &monitor->pipes[i];
+        if (pipe_state->fixed) continue;
+        unsigned long switches = proc_voluntary_switches(pipe_state->writer) +
+                                 proc_voluntary_switches(pipe_state->reader);
+        // 第一次采样只记录基准
+        if (pipe_state->switches > 0 &&
+            switches - pipe_state->switches >= PIPE_GROW_SWITCHES * ms / PIPE_SAMPLE_MS) {
+            pipe_grow(monitor, pipe_state);
+        }
+        pipe_state->switches = switches;
+    }
+}
+
+/**********************************************************************
+ * CPU亲和性与调度类
+ *
+ * affinity选项或cpus关键字决定各阶段的CPU：spread把阶段依次绑定到
+ * shell允许使用的各个CPU上，numa依次绑定到各个NUMA节点，CPU列表
+ * 则把所有阶段限制在列表中。后台作业可以按bgsched选项（或sched关键字）
+ * 以SCHED_BATCH/SCHED_IDLE和较低的I/O优先级运行，不和前台争抢。
+ * 这些设置都在子进程exec之前完成，需要时启动方式退回fork。
+ **********************************************************************/
+
+/**
+ * @brief 解析CPU列表，如"0-3,6"
+ * @return 成功返回0，格式错误或列表为空返回-1
+ */
+int parse_cpu_list(const char *text, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) return -1;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) return -1;
+        }
+        if (last >= CPU_SETSIZE) return -1;
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == ',') end++;
+        else if (*end != '\0' && *end != '\n') return -1;
+        else break;
+        p = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/**
+ * @brief 解析affinity取值：inherit、spread、numa或CPU列表
+ * @return 成功返回AffinityMode（列表存入set），格式错误返回-1
+ */
+int parse_affinity(const char *text, cpu_set_t *set) {
+    for (int i = 0; affinity_choices[i]; i++) {
+        if (strcmp(text, affinity_choices[i]) == 0) {
+            return i;
+        }
+    }
+    return parse_cpu_list(text, set) == 0 ? AFFINITY_LIST : -1;
+}
+
+/**
+ * @brief affinity选项的解析函数，CPU列表保存到affinity_cpus
+ */
+int parse_affinity_option(const char *text, int *value) {
+    cpu_set_t set;
+    int mode = parse_affinity(text, &set);
+    if (mode < 0 || (mode == AFFINITY_LIST && strlen(text) >= AFFINITY_TEXT)) {
+        return -1;
+    }
+    if (mode == AFFINITY_LIST) {
+        affinity_cpus = set;
+        strcpy(affinity_text, text);
+    }
+    *value = mode;
+    return 0;
+}
+
+/**
+ * @brief 显示affinity选项的取值
+ */
+const char *format_affinity(int value) {
+    return value == AFFINITY_LIST ? affinity_text : affinity_choices[value];
+}
+
+/**
+ * @brief 解析调度类名称
+ * @return SchedClass，未知名称返回-1
+ */
+int parse_sched_class(const char *text) {
+    for (int i = 0; sched_choices[i]; i++) {
+        if (strcmp(text, sched_choices[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 读取各NUMA节点的CPU（只读一次），没有NUMA信息时返回0
+ */
+int numa_nodes(cpu_set_t **nodes_out) {
+    static cpu_set_t *nodes = NULL;
+    static int count = -1;
+    if (count < 0) {
+        count = 0;
+        DIR *dir = opendir("/sys/devices/system/node");
+        struct dirent *entry;
+        while (dir && (entry = readdir(dir))) {
+            int node;
+            char path[300], list[4096];
+            if (sscanf(entry->d_name, "node%d", &node) != 1) continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+            FILE *fp = fopen(path, "re");
+            if (!fp) continue;
+            cpu_set_t set;
+            if (fgets(list, sizeof(list), fp) && parse_cpu_list(list, &set) == 0) {
+                cpu_set_t *grown = realloc(nodes, (count + 1) * sizeof(cpu_set_t));
+                if (grown) {
+                    nodes = grown;
+                    nodes[count++] = set;
+                }
+            }
+            fclose(fp);
+        }
+        if (dir) closedir(dir);
+    }
+    *nodes_out = nodes;
+    return count;
+}
+
+/**
+ * @brief 计算下一个阶段的CPU集合，不需要绑定时返回NULL
+ *
+ * spread和numa只在shell自身允许的CPU中轮换，跨作业连续编号，
+ * 依次启动的作业和管道阶段分布在不同的CPU上。
+ */
+cpu_set_t *placement_cpus(int mode, const cpu_set_t *list) {
+    if (mode == AFFINITY_INHERIT) return NULL;
+    cpu_set_t *set = arena_alloc(&line_arena, sizeof(cpu_set_t));
+    if (mode == AFFINITY_LIST) {
+        *set = *list;
+        return set;
+    }
+    
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) return NULL;
+    int nallowed = CPU_COUNT(&allowed);
+    if (nallowed == 0) return NULL;
+    
+    if (mode == AFFINITY_NUMA) {
+        cpu_set_t *nodes;
+        int nnodes = numa_nodes(&nodes);
+        // 跳过与允许的CPU没有交集的节点
+        for (int tries = 0; tries < nnodes; tries++) {
+            CPU_AND(set, &nodes[spread_next++ % nnodes], &allowed);
+            if (CPU_COUNT(set) > 0) return set;
+        }
+        return NULL; // 没有可用的NUMA信息
+    }
+    
+    int k = spread_next++ % nallowed;
+    CPU_ZERO(set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && k-- == 0) {
+            CPU_SET(cpu, set);
+            break;
+        }
+    }
+    return set;
+}
+
+/**
+ * @brief 按关键字和选项填写一个阶段的CPU和调度类
+ */
+void spec_set_placement(LaunchSpec *spec, const CommandLine *cmdline) {
+    if (cmdline->affinity >= 0) {
+        spec->cpus = placement_cpus(cmdline->affinity, cmdline->cpus);
+    } else {
+        spec->cpus = placement_cpus(affinity_mode, &affinity_cpus);
+    }
+    if (cmdline->sched >= 0) {
+        spec->sched = cmdline->sched;
+    } else {
+        spec->sched = cmdline->background ? bg_sched : SCHED_CLASS_NORMAL;
+    }
+}
+
+/**
+ * @brief 在子进程中应用CPU亲和性和调度类，失败只警告
+ */
+void apply_placement(const LaunchSpec *spec) {
+    if (spec->cpus && sched_setaffinity(0, sizeof(cpu_set_t), spec->cpus) == -1) {
+        perror("mybash: sched_setaffinity");
+    }
+    if (spec->sched != SCHED_CLASS_NORMAL) {
+        struct sched_param param = {0};
+        int idle = spec->sched == SCHED_CLASS_IDLE;
+        if (sched_setscheduler(0, idle ? SCHED_IDLE : SCHED_BATCH, &param) == -1) {
+            perror("mybash: sched_setscheduler");
+        }
+        int ioprio = idle ? IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0)
+                          : IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 7);
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) == -1) {
+            perror("mybash: ioprio_set");
+        }
+    }
+}
+
+/**********************************************************************
+ * 子进程回收与事件循环
+ *
+ * SIGCHLD始终处于阻塞状态，通过signalfd以普通事件的形式接收，
+ * 不再有异步信号处理程序。子进程只在主循环中批量回收：
+ * 等待输入时由epoll唤醒，等待前台作业时直接阻塞在wait4上
+ * （自适应管道需要定期采样时改为带超时地等待signalfd）。
+ * wait4同时取得每个进程的资源使用情况，记录在作业的进程记录中。
+ * 后台作业的状态变化先记在作业上，下一次打印提示符前统一报告。
+ **********************************************************************/
+
+/**
+ * @brief 阻塞SIGCHLD并创建signalfd和epoll实例
+ *
+ * 必须在启动任何子进程之前调用。子进程在启动时恢复为空的信号掩码。
+ */
+void init_events() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        perror("sigprocmask");
+        exit(1);
+    }
+    
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (sigchld_fd == -1 || epoll_fd == -1) {
+        perror("signalfd/epoll");
+        exit(1);
+    }
+    
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = sigchld_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sigchld_fd, &ev) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+/**
+ * @brief 把作业加入待报告队列
+ */
+void queue_notification(Job *job) {
+    if (job->notify) {
+        return;
+    }
+    if (notify_len == notify_cap) {
+        int cap = notify_cap ? notify_cap * 2 : JOB_INDEX_BUCKETS;
+        int *queue = realloc(notify_queue, cap * sizeof(int));
+        if (!queue) {
+            perror("realloc");
+            return;
+        }
+        notify_queue = queue;
+        notify_cap = cap;
+    }
+    notify_queue[notify_len++] = job->id;
+    job->notify = 1;
+}
+
+/**
+ * @brief 记录一个子进程的状态变化
+ *
+ * 不属于任何作业的进程（如添加作业失败的后台进程）回收后直接忽略。
+ */
+void record_child(pid_t pid, int status, const struct rusage *usage) {
+    Process *proc;
+    Job *job = find_job_by_pid(pid, &proc);
+    if (!job) {
+        return;
+    }
+    
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        proc->state = JOB_DONE;
+        proc->status = status;
+        proc->usage = *usage;
+        clock_gettime(CLOCK_MONOTONIC, &proc->end);
+    } else if (WIFSTOPPED(status)) {
+        proc->state = JOB_STOPPED;
+        proc->status = status;
+        proc->usage = *usage;
+    } else if (WIFCONTINUED(status)) {
+        proc->state = JOB_RUNNING;
+    }
+    
+    JobStatus old = job->status;
+    job_refresh_status(job);
+    // 前台作业的结果由等待它的代码处理
+    if (job != foreground_job && job->status != old && job->status != JOB_RUNNING) {
+        queue_notification(job);
+    }
+}
+
+/**
+ * @brief 回收所有已改变状态的子进程（不阻塞）
+ */
+void reap_children() {
+    // 清空signalfd，多个SIGCHLD可能已合并为一个
+    struct signalfd_siginfo info[16];
+    while (read(sigchld_fd, info, sizeof(info)) > 0) {
+    }
+    
+    int status;
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        record_child(pid, status, &usage);
+    }
+}
+
+/**
+ * @brief 等待作业结束或暂停
+ *
+ * 期间结束的其他子进程同样被回收并记录到各自的作业上。
+ */
+void wait_for_job(Job *job) {
+    unsigned long long t = stat_now();
+    foreground_job = job;
+    while (job->status == JOB_RUNNING) {
+        int status;
+        struct rusage usage;
+        pid_t pid;
+        if (pipe_monitor) {
+            pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage);
+            if (pid == 0) {
+                struct pollfd pfd = {sigchld_fd, POLLIN, 0};
+                struct signalfd_siginfo info[16];
+                if (poll(&pfd, 1, PIPE_SAMPLE_MS) > 0) {
+                    while (read(sigchld_fd, info, sizeof(info)) > 0) {
+                    }
+                }
+                pipe_monitor_sample(pipe_monitor);
+                continue;
+            }
+        } else {
+            pid = wait4(-1, &status, WUNTRACED | WCONTINUED, &usage);
+        }
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // ECHILD：进程已不存在，按结束处理，避免无限等待
+            for (int i = 0; i < job->nprocs; i++) {
+                job->procs[i].state = JOB_DONE;
+            }
+            job->status = JOB_DONE;
+            break;
+        }
+        record_child(pid, status, &usage);
+    }
+    foreground_job = NULL;
+    stat_record(STAT_WAIT, t);
+}
+
+/**
+ * @brief 报告后台作业的状态变化并删除已完成的作业
+ *
+ * 在打印提示符前调用；非交互模式下只清理不打印。
+ * 队列中的作业可能已被删除或已由jobs报告过，按ID重新查找并检查标志。
+ */
+void flush_notifications() {
+    for (int i = 0; i < notify_len; i++) {
+        Job *job = find_job(notify_queue[i]);
+        if (!job || !job->notify) {
+            continue;
+        }
+        job->notify = 0;
+        if (shell_is_interactive) {
+            printf("[%d]+\t%s\t\t%s\n", job->id,
+                   job->status == JOB_DONE ? "Done" : "Stopped", job->command);
+        }
+        if (job->status == JOB_DONE) {
+            remove_job(job);
+        }
+    }
+    notify_len = 0;
+    fflush(stdout);
+}
+
+/**
+ * @brief 等待输入描述符可读，期间处理子进程事件
+ *
+ * 普通文件不能加入epoll（EPERM），这种情况下总是可读，直接返回。
+ */
+void wait_for_input(int fd) {
+    if (fd != input_fd) {
+        if (input_fd != -1 && input_pollable) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, input_fd, NULL);
+        }
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        input_pollable = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+        input_fd = fd;
+    }
+    if (!input_pollable) {
+        return;
+    }
+    
+    while (1) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epoll_fd, events, 2, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            return;
+        }
+        int ready = 0;
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.fd == sigchld_fd) {
+                reap_children();
+            } else {
+                ready = 1;
+            }
+        }
+        if (ready) {
+            return;
+        }
+    }
+}
+
+/**********************************************************************
+ * 命令路径哈希表
+ **********************************************************************/
+
+/**
+ * @brief 计算字符串哈希值（FNV-1a）
+ */
+unsigned int hash_string(const char *str) {
+    unsigned int h = 2166136261u;
+    while (*str) {
+        h ^= (unsigned char)*str++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief 清空命令路径哈希表
+ */
+void hash_clear() {
+    for (int i = 0; i < HASH_BUCKETS; i++) {
+        HashEntry *entry = hash_table[i];
+        while (entry) {
+            HashEntry *next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry = next;
+        }
+        hash_table[i] = NULL;
+    }
+}
+
+/**
+ * @brief PATH发生变化时使整张表失效
+ *
+ * 每条命令执行前调用一次，保证同一条命令解析出的路径在fork前都有效。
+ */
+void hash_check_path() {
+    if (hash_path_version == vars.path_version && hash_path_env) {
+        return;
+    }
+    const char *path = var_get("PATH");
+    if (!path) path = "";
+    if (!hash_path_env || strcmp(hash_path_env, path) != 0) {
+        hash_clear();
+        free(hash_path_env);
+        hash_path_env = strdup(path);
+    }
+    hash_path_version = vars.path_version;
+}
+
+/**
+ * @brief 判断路径是否为可执行的普通文件
+ */
+int is_executable(const char *pathname) {
+    struct stat st;
+    return stat(pathname, &st) == 0 && S_ISREG(st.st_mode) &&
+           access(pathname, X_OK) == 0;
+}
+
+/**
+ * @brief 依次在PATH_BIN和$PATH中查找命令
+ * @return 新分配的完整路径，找不到时返回NULL
+ */
+char *search_command(const char *name) {
+    char pathname[4096];
+
+    snprintf(pathname, sizeof(pathname), "%s%s", PATH_BIN, name);
+    if (is_executable(pathname)) {
+        return strdup(pathname);
+    }
+
+    const char *dirs = hash_path_env ? hash_path_env : "";
+    while (*dirs) {
+        const char *end = strchr(dirs, ':');
+        size_t len = end ? (size_t)(end - dirs) : strlen(dirs);
+        // 空的PATH项表示当前目录
+        if (len == 0) {
+            snprintf(pathname, sizeof(pathname), "%s", name);
+        } else {
+            snprintf(pathname, sizeof(pathname), "%.*s/%s", (int)len, dirs, name);
+        }
+        if (is_executable(pathname)) {
+            return strdup(pathname);
+        }
+        if (!end) break;
+        dirs = end + 1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 查找哈希表项
+ */
+HashEntry *hash_find(const char *name) {
+    HashEntry *entry = hash_table[hash_string(name) % HASH_BUCKETS];
+    while (entry && strcmp(entry->name, name) != 0) {
+        entry = entry->next;
+    }
+    return entry;
+}
+
+/**
+ * @brief 解析命令并加入哈希表（已存在时直接返回）
+ */
+HashEntry *hash_insert(const char *name) {
+    HashEntry *entry = hash_find(name);
+    if (entry) return entry;
+
+    char *path = search_command(name);
+    if (!path) return NULL;
+
+    entry = malloc(sizeof(HashEntry));
+    if (!entry || !(entry->name = strdup(name))) {
+        free(entry);
+        free(path);
+        return NULL;
+    }
+    entry->path = path;
+    entry->hits = 0;
+
+    unsigned int idx = hash_string(name) % HASH_BUCKETS;
+    entry->next = hash_table[idx];
+    hash_table[idx] = entry;
+    
+    // 守护进程的会话：一行不超过PIPE_BUF的写入是原子的，管道满时放弃
+    size_t len = strlen(name);
+    if (hash_learn_fd >= 0 && len < PIPE_BUF) {
+        char line[PIPE_BUF];
+        memcpy(line, name, len);
+        line[len] = '\n';
+        ssize_t n = write(hash_learn_fd, line, len + 1);
+        (void)n;
+    }
+    return entry;
+}
+
+/**
+ * @brief 从哈希表中删除一项
+ */
+void hash_forget(const char *name) {
+    HashEntry **link = &hash_table[hash_string(name) % HASH_BUCKETS];
+    while (*link) {
+        HashEntry *entry = *link;
+        if (strcmp(entry->name, name) == 0) {
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+/**
+ * @brief 将命令名解析为可执行文件路径
+ *
+ * 含'/'的命令名按原样使用；否则首次使用时查找并缓存，之后直接命中。
+ * @return 路径字符串（归哈希表所有），找不到时返回NULL
+ */
+const char *lookup_command(const char *name) {
+    if (strchr(name, '/')) {
+        return name;
+    }
+    HashEntry *entry = hash_insert(name);
+    if (!entry) return NULL;
+    entry->hits++;
+    return entry->path;
+}
+
+/**
+ * @brief 子进程中执行已解析的命令，失败时退出
+ *
+ * 缓存的路径已失效（ENOENT）时退回到execvp重新查找，
+ * 父进程看到EXIT_NOT_FOUND后会再校验并删除该表项。
+ */
+void exec_resolved(const char *path, char **argv) {
+    execve(path, argv, environ); // environ即缓存的导出变量（var_environ）
+    if (errno == ENOENT && path != argv[0]) {
+        execvp(argv[0], argv);
+    }
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+    exit(EXIT_NOT_FOUND);
+}
+
+/**
+ * @brief 子进程以EXIT_NOT_FOUND退出后校验对应的缓存项
+ */
+void hash_validate(const char *name) {
+    HashEntry *entry = hash_find(name);
+    if (entry && !is_executable(entry->path)) {
+        hash_forget(name);
+    }
+}
+
+/**********************************************************************
+ * 进程启动
+ **********************************************************************/
+
+/**
+ * @brief 追加一个描述符操作，数组在行内存池中按倍增扩容
+ */
+FdAction *spec_add_action(LaunchSpec *spec) {
+    if (spec->nactions == spec->action_cap) {
+        int cap = spec->action_cap ? spec->action_cap * 2 : 4;
+        FdAction *actions = arena_alloc(&line_arena, cap * sizeof(FdAction));
+        if (spec->nactions > 0) {
+            memcpy(actions, spec->actions, spec->nactions * sizeof(FdAction));
+        }
+        spec->actions = actions;
+        spec->action_cap = cap;
+    }
+    return &spec->actions[spec->nactions++];
+}
+
+/**
+ * @brief 添加复制描述符的操作
+ */
+void spec_add_dup2(LaunchSpec *spec, int src, int fd) {
+    FdAction *action = spec_add_action(spec);
+    action->type = FD_DUP2;
+    action->fd = fd;
+    action->src = src;
+}
+
+/**
+ * @brief 添加关闭描述符的操作
+ */
+void spec_add_close(LaunchSpec *spec, int fd) {
+    FdAction *action = spec_add_action(spec);
+    action->type = FD_CLOSE;
+    action->fd = fd;
+}
+
+/**
+ * @brief 子进程中依次完成进程组、终端、信号、CPU与调度类和描述符设置后exec
+ *
+ * 由launch_fork和fork服务进程共用，不返回。
+ */
+void launch_child(const LaunchSpec *spec) {
+    if (spec->pgid >= 0 && setpgid(0, spec->pgid) == -1) {
+        perror("setpgid");
+        exit(1);
+    }
+    
+    // 前台作业由子进程自己取得终端，避免与父进程竞争
+    if (spec->foreground && shell_is_interactive) {
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+    }
+    
+    // 恢复默认信号处理
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    
+    // shell始终阻塞SIGCHLD（由signalfd接收），子进程恢复为空的信号掩码
+    sigset_t sigmask;
+    sigemptyset(&sigmask);
+    sigprocmask(SIG_SETMASK, &sigmask, NULL);
+    
+    apply_placement(spec);
+    
+    for (int i = 0; i < spec->nactions; i++) {
+        FdAction *action = &spec->actions[i];
+        if (action->type == FD_CLOSE) {
+            close(action->fd);
+        } else if (action->src == action->fd) {
+            // dup2对相同描述符什么也不做，需要单独清除FD_CLOEXEC（如1>&1）
+            fcntl(action->fd, F_SETFD, 0);
+        } else if (dup2(action->src, action->fd) == -1) {
+            perror("dup2");
+            exit(1);
+        }
+    }
+    
+    if (spec->func) {
+        int argc = 0;
+        while (spec->argv[argc]) argc++;
+        exit(spec->func(argc, spec->argv));
+    }
+    exec_resolved(spec->path, spec->argv);
+}
+
+/**
+ * @brief 用fork启动子进程
+ */
+pid_t launch_fork(LaunchSpec *spec) {
+    // 子进程中运行内置命令时会继承stdio缓冲区，先刷出避免重复输出
+    if (spec->func) {
+        fflush(NULL);
+    }
+    
+    unsigned long long t = stat_now();
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return -1;
+    }
+    if (pid > 0) {
+        stat_record(STAT_FORK, t);
+    }
+    
+    if (pid == 0) { // 子进程
+        launch_child(spec);
+    }
+    
+    // 父进程同样设置进程组，保证返回前子进程已进入目标进程组
+    // （子进程已exec或已退出时会失败，可以忽略）
+    t = stat_now();
+    if (spec->pgid >= 0 && setpgid(pid, spec->pgid ? spec->pgid : pid) == -1 &&
+        errno != EACCES && errno != ESRCH) {
+        perror("setpgid");
+    }
+    stat_record(STAT_SETPGID, t);
+    
+    return pid;
+}
+
+/**
+ * @brief 用posix_spawn启动子进程
+ *
+ * 进程组、信号默认处理和描述符操作都表达为spawn属性与文件操作，
+ * glibc以CLONE_VM|CLONE_VFORK创建子进程，开销与shell的内存大小无关。
+ * 重定向文件已由调用者在父进程中打开，这里只有dup2和close操作。
+ * @return 子进程pid；失败时返回-1，errno为失败原因
+ */
+pid_t launch_spawn(LaunchSpec *spec) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t file_actions;
+    pid_t pid = -1;
+    int err = 0;
+    
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&file_actions);
+    
+    for (int i = 0; i < spec->nactions; i++) {
+        FdAction *action = &spec->actions[i];
+        if (action->type == FD_CLOSE) {
+            posix_spawn_file_actions_addclose(&file_actions, action->fd);
+        } else {
+            // 源和目标相同时glibc按POSIX清除FD_CLOEXEC
+            posix_spawn_file_actions_adddup2(&file_actions, action->src, action->fd);
+        }
+    }
+    
+#ifdef HAVE_SPAWN_TCSETPGRP
+    if (spec->foreground && shell_is_interactive) {
+        posix_spawn_file_actions_addtcsetpgrp_np(&file_actions, STDIN_FILENO);
+    }
+#endif
+    
+    sigset_t sigdefault;
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGINT);
+    sigaddset(&sigdefault, SIGQUIT);
+    sigaddset(&sigdefault, SIGTSTP);
+    sigaddset(&sigdefault, SIGTTIN);
+    sigaddset(&sigdefault, SIGTTOU);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    
+    sigset_t sigmask;
+    sigemptyset(&sigmask);
+    posix_spawnattr_setsigmask(&attr, &sigmask);
+    
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    if (spec->pgid >= 0) {
+        posix_spawnattr_setpgroup(&attr, spec->pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+    
+    unsigned long long t = stat_now();
+    err = posix_spawn(&pid, spec->path, &file_actions, &attr, spec->argv, environ);
+    stat_record(STAT_SPAWN, t);
+    if (err != 0) {
+        pid = -1;
+    }
+    
+    posix_spawn_file_actions_destroy(&file_actions);
+    posix_spawnattr_destroy(&attr);
+    errno = err;
+    return pid;
+}
+
+/**********************************************************************
+ * fork服务进程（set -o launch=server）
+ *
+ * shell的地址空间变大后，每次fork复制的页表也随之变多。服务进程由
+ * posix_spawn执行/proc/self/exe --fork-server得到，地址空间始终很小。
+ * shell通过socketpair发送启动请求：argv、envp、当前目录、要安装的
+ * 描述符（SCM_RIGHTS）、进程组和调度设置；服务进程用CLONE_PARENT
+ * 创建子进程，子进程的父进程仍是shell，作业控制和wait4照常工作。
+ * 服务进程不可用时退回fork。
+ **********************************************************************/
+
+/**
+ * @brief 完整写入len字节（不产生SIGPIPE）
+ * @return 成功返回0，失败返回-1
+ */
+int send_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief 完整读取len字节
+ * @return 成功返回0，出错或提前EOF返回-1
+ */
+int recv_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief 发送数据，附带SCM_RIGHTS描述符
+ */
+int send_with_fds(int sock, const void *buf, size_t len, const int *fds, int nfds) {
+    struct iovec iov = {(void *)buf, len};
+    char control[CMSG_SPACE(SERVER_MAX_FDS * sizeof(int))];
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+    // 描述符随第一个字节送出，剩余部分按普通数据补发
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+    return send_full(sock, (const char *)buf + n, len - n);
+}
+
+/**
+ * @brief 接收send_with_fds发送的数据和描述符（描述符带FD_CLOEXEC）
+ * @return 成功返回0，EOF或出错返回-1
+ */
+int recv_with_fds(int sock, void *buf, size_t len, int *fds, int *nfds) {
+    struct iovec iov = {buf, len};
+    char control[CMSG_SPACE(SERVER_MAX_FDS * sizeof(int))];
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+    
+    *nfds = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds + *nfds, CMSG_DATA(cmsg), count * sizeof(int));
+            *nfds += count;
+        }
+    }
+    return recv_full(sock, (char *)buf + n, len - n);
+}
+
+/**
+ * @brief fork服务进程的主循环：--fork-server <描述符>
+ *
+ * 每个请求创建一个子进程并回复pid（失败时回复-errno）。shell关闭socket后退出。
+ */
+int fork_server_main(int sock) {
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+    ServerRequest req;
+    int fds[SERVER_MAX_FDS];
+    int nfds;
+    
+    while (recv_with_fds(sock, &req, sizeof(req), fds, &nfds) == 0) {
+        char *data = malloc(req.len + 1);
+        char **strs = malloc((req.nargs + req.nenv + 2) * sizeof(char *));
+        if (!data || !strs || recv_full(sock, data, req.len) != 0) {
+            return 1;
+        }
+        
+        // path、argv、envp依次排列
+        char *p = data;
+        char *path = p;
+        p += strlen(p) + 1;
+        char **argv = strs;
+        char **envp = strs + req.nargs + 1;
+        for (int i = 0; i < req.nargs; i++, p += strlen(p) + 1) argv[i] = p;
+        argv[req.nargs] = NULL;
+        for (int i = 0; i < req.nenv; i++, p += strlen(p) + 1) envp[i] = p;
+        envp[req.nenv] = NULL;
+        
+        // 收到的描述符移到所有目标描述符之上，避免按顺序dup2时被覆盖
+        int base = 10;
+        for (int i = 0; i < req.nactions; i++) {
+            if (req.actions[i].fd >= base) base = req.actions[i].fd + 1;
+        }
+        for (int i = 0; i < nfds; i++) {
+            if (fds[i] < base) {
+                int moved = fcntl(fds[i], F_DUPFD_CLOEXEC, base);
+                close(fds[i]);
+                fds[i] = moved;
+            }
+        }
+        
+        LaunchSpec spec = {0};
+        FdAction actions[SERVER_MAX_FDS];
+        spec.path = path;
+        spec.argv = argv;
+        spec.pgid = req.pgid;
+        spec.foreground = req.foreground;
+        spec.sched = req.sched;
+        spec.cpus = req.has_cpus ? &req.cpus : NULL;
+        spec.actions = actions;
+        spec.nactions = req.nactions;
+        int next = 1;
+        int stdio[3] = {-1, -1, -1};
+        for (int i = 0; i < 3; i++) {
+            if (req.stdio & (1 << i)) stdio[i] = fds[next++];
+        }
+        for (int i = 0; i < req.nactions; i++) {
+            actions[i].type = req.actions[i].type;
+            actions[i].fd = req.actions[i].fd;
+            if (actions[i].type == FD_DUP2) actions[i].src = fds[next++];
+        }
+        
+        // 子进程的父进程是shell，由shell回收
+        pid_t pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, 0);
+        if (pid == 0) {
+            if (fchdir(fds[0]) == -1) {
+                perror("fchdir");
+                exit(1);
+            }
+            for (int i = 0; i < 3; i++) {
+                if (stdio[i] < 0) {
+                    close(i);
+                } else if (dup2(stdio[i], i) == -1) {
+                    perror("dup2");
+                    exit(1);
+                }
+            }
+            environ = envp;
+            shell_is_interactive = req.interactive;
+            launch_child(&spec);
+        }
+        int32_t reply = pid == -1 ? -errno : pid;
+        
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+        free(data);
+        free(strs);
+        if (send_full(sock, &reply, sizeof(reply)) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 启动fork服务进程（独立进程组，不接收终端信号）
+ * @return 成功返回0，失败返回-1
+ */
+int server_start() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+        return -1;
+    }
+    char fd_arg[16];
+    snprintf(fd_arg, sizeof(fd_arg), "%d", sv[1]);
+    char *argv[] = {"mybash02", "--fork-server", fd_arg, NULL};
+    
+    posix_spawn_file_actions_t file_actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_adddup2(&file_actions, sv[1], sv[1]); // 清除FD_CLOEXEC
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+    pid_t pid;
+    int err = posix_spawn(&pid, "/proc/self/exe", &file_actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+    posix_spawnattr_destroy(&attr);
+    close(sv[1]);
+    if (err != 0) {
+        close(sv[0]);
+        fprintf(stderr, "mybash: fork server: %s\n", strerror(err));
+        return -1;
+    }
+    server_fd = sv[0];
+    return 0;
+}
+
+/**
+ * @brief 通过fork服务进程启动子进程
+ * @return 子进程pid；失败时返回-1，服务进程不可用时errno为ENOTCONN
+ */
+pid_t launch_server(LaunchSpec *spec) {
+    if (server_fd < 0 && server_start() != 0) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    
+    ServerRequest req;
+    memset(&req, 0, sizeof(req));
+    int fds[SERVER_MAX_FDS];
+    int nfds = 0;
+    if (spec->nactions + 4 > SERVER_MAX_FDS) {
+        errno = ENOTCONN; // 描述符太多，交给fork
+        return -1;
+    }
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0) {
+        return -1;
+    }
+    fds[nfds++] = cwd;
+    for (int i = 0; i < 3; i++) {
+        if (fcntl(i, F_GETFD) != -1) {
+            req.stdio |= 1 << i;
+            fds[nfds++] = i;
+        }
+    }
+    req.nactions = spec->nactions;
+    for (int i = 0; i < spec->nactions; i++) {
+        req.actions[i].type = spec->actions[i].type;
+        req.actions[i].fd = spec->actions[i].fd;
+        if (spec->actions[i].type == FD_DUP2) {
+            fds[nfds++] = spec->actions[i].src;
+        }
+    }
+    
+    // 字符串数据：path、argv、envp
+    size_t len = strlen(spec->path) + 1;
+    for (req.nargs = 0; spec->argv[req.nargs]; req.nargs++) {
+        len += strlen(spec->argv[req.nargs]) + 1;
+    }
+    for (req.nenv = 0; environ[req.nenv]; req.nenv++) {
+        len += strlen(environ[req.nenv]) + 1;
+    }
+    char *data = arena_alloc(&line_arena, len);
+    char *p = stpcpy(data, spec->path) + 1;
+    for (int i = 0; i < req.nargs; i++) p = stpcpy(p, spec->argv[i]) + 1;
+    for (int i = 0; i < req.nenv; i++) p = stpcpy(p, environ[i]) + 1;
+    req.len = len;
+    // 服务进程在自己的进程组中，"留在当前进程组"要换成具体的组ID
+    req.pgid = spec->pgid == -1 ? getpgrp() : spec->pgid;
+    req.foreground = spec->foreground;
+    req.interactive = shell_is_interactive;
+    req.sched = spec->sched;
+    if (spec->cpus) {
+        req.has_cpus = 1;
+        req.cpus = *spec->cpus;
+    }
+    
+    unsigned long long t = stat_now();
+    int32_t reply;
+    int ok = send_with_fds(server_fd, &req, sizeof(req), fds, nfds) == 0 &&
+             send_full(server_fd, data, len) == 0 &&
+             recv_full(server_fd, &reply, sizeof(reply)) == 0;
+    close(cwd);
+    if (!ok) {
+        // 服务进程已退出，以后都退回fork
+        close(server_fd);
+        server_fd = -1;
+        launch_mode = LAUNCH_FORK;
+        fprintf(stderr, "mybash: fork server unavailable, using fork\n");
+        errno = ENOTCONN;
+        return -1;
+    }
+    stat_record(STAT_SERVER, t);
+    if (reply < 0) {
+        errno = -reply;
+        return -1;
+    }
+    
+    // 子进程是shell的直接子进程，同样在父进程中设置进程组
+    pid_t pid = reply;
+    if (spec->pgid >= 0 && setpgid(pid, spec->pgid ? spec->pgid : pid) == -1 &&
+        errno != EACCES && errno != ESRCH) {
+        perror("setpgid");
+    }
+    return pid;
+}
+
+/**
+ * @brief 按当前launch选项启动子进程
+ *
+ * spawn失败且缓存路径已不存在时，删除缓存重新查找一次。
+ * 无法在spawn中转移终端时，交互式前台作业退回fork方式。
+ */
+pid_t launch_process(LaunchSpec *spec) {
+    var_environ(); // 导出变量有变化时重建environ，否则直接沿用
+    reader_sync(shared_input);
+    if (launch_mode == LAUNCH_SERVER && !spec->func) {
+        pid_t pid = launch_server(spec);
+        if (pid != -1) {
+            return pid;
+        }
+        if (errno != ENOTCONN) {
+            int err = errno;
+            fprintf(stderr, "%s: %s\n", spec->argv[0], strerror(err));
+            errno = err;
+            return -1;
+        }
+        return launch_fork(spec);
+    }
+    
+    int use_spawn = launch_mode == LAUNCH_SPAWN;
+#ifndef HAVE_SPAWN_TCSETPGRP
+    if (spec->foreground && shell_is_interactive) {
+        use_spawn = 0;
+    }
+#endif
+    // posix_spawn不能设置CPU亲和性和I/O优先级
+    if (!use_spawn || spec->func || spec->cpus || spec->sched != SCHED_CLASS_NORMAL) {
+        return launch_fork(spec);
+    }
+    
+    pid_t pid = launch_spawn(spec);
+    if (pid == -1 && errno == ENOENT && spec->path != spec->argv[0] &&
+        !is_executable(spec->path)) {
+        hash_forget(spec->argv[0]);
+        spec->path = lookup_command(spec->argv[0]);
+        if (spec->path) {
+            pid = launch_spawn(spec);
+        } else {
+            errno = ENOENT;
+        }
+    }
+    if (pid == -1) {
+        int err = errno;
+        fprintf(stderr, "%s: %s\n", spec->argv[0], strerror(err));
+        errno = err;
+    }
+    return pid;
+}
+
+/**
+ * @brief launch_process失败后对应的退出状态
+ */
+int launch_failure_status() {
+    return errno == ENOENT ? EXIT_NOT_FOUND : EXIT_NOT_FOUND - 1;
+}
+
+/**********************************************************************
+ * 命令历史
+ *
+ * 历史文件只追加，每行一条记录。交互模式下每行命令执行前追加到文件末尾
+ * （O_APPEND的一次writev，flock(LOCK_EX)保护，多个shell同时追加不会交错），
+ * 启动时不读取文件。第一次查询时才把文件映射进内存，建立每条记录的起始
+ * 偏移索引；之后只对其他shell新追加的部分增量建索引，history N和!引用
+ * 都按序号直接定位。子串搜索使用三元组倒排索引：取查询中记录最少的
+ * 三元组，从新到旧逐条核对。
+ **********************************************************************/
+
+/**
+ * @brief 打开历史文件（HISTFILE或~/.mybash02_history）
+ * @return 成功返回0，失败返回-1
+ */
+int history_open() {
+    if (history.fd >= 0) {
+        return 0;
+    }
+    char path[PATH_MAX];
+    const char *file = var_get("HISTFILE");
+    if (!file || !*file) {
+        const char *home = var_get("HOME");
+        if (!home) {
+            struct passwd *pw = getpwuid(getuid());
+            home = pw ? pw->pw_dir : "/";
+        }
+        snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE);
+        file = path;
+    }
+    history.fd = open(file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    return history.fd >= 0 ? 0 : -1;
+}
+
+/**
+ * @brief 追加一条记录，不读取也不映射文件
+ */
+void history_add(const char *line) {
+    if (history_open() != 0) {
+        return;
+    }
+    struct iovec iov[2] = {{(void *)line, strlen(line)}, {"\n", 1}};
+    flock(history.fd, LOCK_EX);
+    ssize_t n = writev(history.fd, iov, 2);
+    (void)n;
+    flock(history.fd, LOCK_UN);
+}
+
+/**
+ * @brief 丢弃映射和全部索引（文件被截断或替换时重建）
+ */
+void history_reset() {
+    if (history.map) {
+        munmap(history.map, history.mapped);
+    }
+    for (int i = 0; i <= history.trigram_mask && history.trigrams; i++) {
+        free(history.trigrams[i].entries);
+    }
+    free(history.trigrams);
+    free(history.offsets);
+    int fd = history.fd;
+    memset(&history, 0, sizeof(history));
+    history.fd = fd;
+}
+
+/**
+ * @brief 把映射和偏移索引更新到文件当前的末尾
+ *
+ * 追加都在排他锁下一次写完整行，持共享锁取得的文件大小总在行尾；
+ * 仍然只索引到最后一个换行符为止。偏移用32位保存，超过4GB的部分不索引。
+ * @return 成功返回0，失败返回-1
+ */
+int history_sync() {
+    if (history_open() != 0) {
+        return -1;
+    }
+    struct stat st;
+    flock(history.fd, LOCK_SH);
+    int err = fstat(history.fd, &st);
+    flock(history.fd, LOCK_UN);
+    if (err != 0) {
+        return -1;
+    }
+    size_t size = st.st_size > UINT32_MAX ? UINT32_MAX : (size_t)st.st_size;
+    if (size < history.indexed) {
+        history_reset();
+    }
+    if (size == history.indexed) {
+        return 0;
+    }
+    
+    if (size > history.mapped) {
+        char *map = history.map ?
+            mremap(history.map, history.mapped, size, MREMAP_MAYMOVE) :
+            mmap(NULL, size, PROT_READ, MAP_SHARED, history.fd, 0);
+        if (map == MAP_FAILED) {
+            return -1;
+        }
+        history.map = map;
+        history.mapped = size;
+    }
+    
+    const char *p = history.map + history.indexed;
+    const char *end = history.map + size;
+    const char *newline;
+    while (p < end && (newline = memchr(p, '\n', end - p))) {
+        if (history.count == history.cap) {
+            int cap = history.cap ? history.cap * 2 : 1024;
+            uint32_t *offsets = realloc(history.offsets, cap * sizeof(uint32_t));
+            if (!offsets) {
+                break;
+            }
+            history.offsets = offsets;
+            history.cap = cap;
+        }
+        history.offsets[history.count++] = p - history.map;
+        p = newline + 1;
+    }
+    history.indexed = p - history.map;
+    return 0;
+}
+
+/**
+ * @brief 取第i条记录（从0开始，不含换行符，不以'\0'结尾）
+ */
+const char *history_entry(int i, size_t *len) {
+    size_t start = history.offsets[i];
+    size_t end = i + 1 < history.count ? history.offsets[i + 1] : history.indexed;
+    *len = end - start - 1;
+    return history.map + start;
+}
+
+/**
+ * @brief 三个字节拼成的三元组键
+ */
+static inline uint32_t trigram_key(const char *s) {
+    return (unsigned char)s[0] << 16 | (unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+/**
+ * @brief 查找三元组的记录列表，create时不存在则插入空列表
+ */
+TrigramList *trigram_find(uint32_t key, int create) {
+    if (history.trigram_mask == 0) {
+        if (!create) return NULL;
+        history.trigrams = calloc(TRIGRAM_BUCKETS, sizeof(TrigramList));
+        if (!history.trigrams) return NULL;
+        history.trigram_mask = TRIGRAM_BUCKETS - 1;
+    }
+    unsigned int slot = (key * 2654435761u) & history.trigram_mask;
+    while (history.trigrams[slot].key != key) {
+        if (history.trigrams[slot].key == 0) {
+            if (!create) return NULL;
+            break;
+        }
+        slot = (slot + 1) & history.trigram_mask;
+    }
+    if (history.trigrams[slot].key == key) {
+        return &history.trigrams[slot];
+    }
+    
+    // 装填因子超过70%时倍增后重新插入
+    if ((history.trigram_used + 1) * 10 > (history.trigram_mask + 1) * 7) {
+        int size = (history.trigram_mask + 1) * 2;
+        TrigramList *table = calloc(size, sizeof(TrigramList));
+        if (!table) return NULL;
+        for (int i = 0; i <= history.trigram_mask; i++) {
+            if (history.trigrams[i].key == 0) continue;
+            unsigned int s = (history.trigrams[i].key * 2654435761u) & (size - 1);
+            while (table[s].key != 0) s = (s + 1) & (size - 1);
+            table[s] = history.trigrams[i];
+        }
+        free(history.trigrams);
+        history.trigrams = table;
+        history.trigram_mask = size - 1;
+        return trigram_find(key, create);
+    }
+    history.trigrams[slot].key = key;
+    history.trigram_used++;
+    return &history.trigrams[slot];
+}
+
+/**
+ * @brief 把尚未加入三元组索引的记录加入索引
+ */
+void history_index_trigrams() {
+    for (; history.trigram_count < history.count; history.trigram_count++) {
+        int i = history.trigram_count;
+        size_t len;
+        const char *text = history_entry(i, &len);
+        for (size_t j = 0; j + 3 <= len; j++) {
+            TrigramList *list = trigram_find(trigram_key(text + j), 1);
+            if (!list) return;
+            // 同一条记录中重复的三元组只记一次
+            if (list->count > 0 && list->entries[list->count - 1] == (uint32_t)i) {
+                continue;
+            }
+            if (list->count == list->cap) {
+                uint32_t cap = list->cap ? list->cap * 2 : 4;
+                uint32_t *entries = realloc(list->entries, cap * sizeof(uint32_t));
+                if (!entries) return;
+                list->entries = entries;
+                list->cap = cap;
+            }
+            list->entries[list->count++] = i;
+        }
+    }
+}
+
+/**
+ * @brief 从第before条之前向旧的方向查找包含query的记录
+ *
+ * 增量搜索时把上一次的结果作为before继续找下一条。
+ * @return 记录序号，没有时返回-1
+ */
+int history_search(const char *query, int before) {
+    if (history_sync() != 0) {
+        return -1;
+    }
+    if (before < 0 || before > history.count) {
+        before = history.count;
+    }
+    size_t qlen = strlen(query);
+    size_t len;
+    if (qlen < 3) {
+        for (int i = before - 1; i >= 0; i--) {
+            const char *text = history_entry(i, &len);
+            if (memmem(text, len, query, qlen)) return i;
+        }
+        return -1;
+    }
+    
+    history_index_trigrams();
+    TrigramList *best = NULL;
+    for (size_t j = 0; j + 3 <= qlen; j++) {
+        TrigramList *list = trigram_find(trigram_key(query + j), 0);
+        if (!list) return -1;
+        if (!best || list->count < best->count) best = list;
+    }
+    // 二分找到第一个不小于before的位置，再向前逐条核对
+    int lo = 0, hi = best->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (best->entries[mid] < (uint32_t)before) lo = mid + 1;
+        else hi = mid;
+    }
+    for (int k = lo - 1; k >= 0; k--) {
+        int i = best->entries[k];
+        const char *text = history_entry(i, &len);
+        if (memmem(text, len, query, qlen)) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief 展开行首的历史引用：!!、!N、!-N、!前缀
+ *
+ * 引用到第一个空白或|&<>为止，其后的内容原样保留，如"!! | wc -l"。
+ * 交互模式下先回显展开后的行。
+ * @return 展开后的行（分配在line_arena中），不是历史引用时返回原行，找不到时报错并返回NULL
+ */
+char *history_expand(char *line) {
+    if (line[0] != '!' || strchr(" \t=", line[1])) {
+        return line;
+    }
+    char *event = line + 1;
+    size_t elen = strcspn(event, " \t|&<>");
+    if (history_sync() != 0) {
+        fprintf(stderr, "mybash: history: %s\n", strerror(errno));
+        return NULL;
+    }
+    
+    int idx = -1;
+    char *endp;
+    long n = strtol(event, &endp, 10);
+    if (elen == 1 && event[0] == '!') {
+        idx = history.count - 1;
+    } else if (endp == event + elen && elen > 0) {
+        idx = n > 0 ? n - 1 : history.count + n;
+        if (idx < 0 || idx >= history.count) idx = -1;
+    } else {
+        char *prefix = arena_alloc(&line_arena, elen + 1);
+        memcpy(prefix, event, elen);
+        prefix[elen] = '\0';
+        size_t len;
+        for (idx = history_search(prefix, -1); idx >= 0; idx = history_search(prefix, idx)) {
+            const char *text = history_entry(idx, &len);
+            if (len >= elen && memcmp(text, prefix, elen) == 0) break;
+        }
+    }
+    if (idx < 0) {
+        fprintf(stderr, "mybash: !%.*s: event not found\n", (int)elen, event);
+        return NULL;
+    }
+    
+    size_t len;
+    const char *text = history_entry(idx, &len);
+    const char *rest = event + elen;
+    char *expanded = arena_alloc(&line_arena, len + strlen(rest) + 1);
+    memcpy(expanded, text, len);
+    strcpy(expanded + len, rest);
+    if (shell_is_interactive) {
+        printf("%s\n", expanded);
+        fflush(stdout);
+    }
+    return expanded;
+}
+
+/**********************************************************************
+ * 内置命令实现
+ **********************************************************************/
+
+/**
+ * @brief 作业和进程状态的名称
+ */
+const char *job_status_name(JobStatus status) {
+    switch (status) {
+        case JOB_RUNNING: return "Running";
+        case JOB_STOPPED: return "Stopped";
+        case JOB_DONE: return "Done";
+    }
+    return "";
+}
+
+/**
+ * @brief 把timeval转换为秒数
+ */
+double timeval_seconds(const struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/**
+ * @brief jobs -l：打印一个进程的pid、状态和资源使用情况
+ *
+ * 资源使用情况由wait4在进程结束或暂停时得到，运行中的进程没有这些数据。
+ */
+void print_process_usage(const Process *proc) {
+    printf("\t%d\t%s", proc->pid, job_status_name(proc->state));
+    if (proc->state != JOB_RUNNING) {
+        const struct rusage *ru = &proc->usage;
+        printf("\tuser %.3fs sys %.3fs maxrss %ldKB flt %ld/%ld csw %ld/%ld",
+               timeval_seconds(&ru->ru_utime), timeval_seconds(&ru->ru_stime),
+               ru->ru_maxrss, ru->ru_minflt, ru->ru_majflt, ru->ru_nvcsw, ru->ru_nivcsw);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief 打印作业列表，-l同时列出每个进程的资源使用情况
+ */
+int cmd_jobs(int argc, char **argv) {
+    int detail = argc > 1 && strcmp(argv[1], "-l") == 0;
+    reap_children();
+    
+    for (Job *job = job_head; job; job = job->next) {
+        printf("[%d]\t%s\t\t%s\n", job->id, job_status_name(job->status), job->command);
+        if (detail) {
+            for (int i = 0; i < job->nprocs; i++) {
+                print_process_usage(&job->procs[i]);
+            }
+        }
+        job->notify = 0; // 已经报告过
+    }
+    cleanup_jobs(); // 已完成的作业报告一次后删除
+    return 0;
+}
+
+/**
+ * @brief 将后台作业切换到前台运行
+ */
+int cmd_fg(int job_id) {
+    Job *job = NULL;
+    
+    // 如果没有指定job_id，使用最近的作业
+    if (job_id == -1) {
+        job = job_tail;
+    } else {
+        job = find_job(job_id);
+    }
+    
+    if (!job) {
+        printf("fg: %d: no such job\n", job_id);
+        return 1;
+    }
+    
+    // 更新作业状态
+    job_mark_running(job);
+    
+    if (shell_is_interactive) {
+        // 设置前台进程组
+        tcsetpgrp(STDIN_FILENO, job->pgid);
+    }
+    
+    // 发送SIGCONT信号继续运行作业
+    kill(-job->pgid, SIGCONT);
+    
+    // 等待作业完成或暂停
+    wait_for_job(job);
+    
+    if (shell_is_interactive) {
+        // 重新获取终端控制权
+        tcsetpgrp(STDIN_FILENO, shell_pgid);
+    }
+    
+    int status = job_exit_status(job);
+    if (job->status == JOB_DONE) {
+        remove_job(job);
+    } else {
+        printf("\n[%d]+\tStopped\t\t%s\n", job->id, job->command);
+    }
+    return status;
+}
+
+/**
+ * @brief 将暂停的作业切换到后台运行
+ */
+int cmd_bg(int job_id) {
+    Job *job = NULL;
+    
+    // 如果没有指定job_id，使用最近的暂停作业
+    if (job_id == -1) {
+        job = job_tail;
+        while (job && job->status != JOB_STOPPED) {
+            job = job->prev;
+        }
+    } else {
+        job = find_job(job_id);
+    }
+    
+    if (!job) {
+        printf("bg: %d: no such job\n", job_id);
+        return 1;
+    }
+    
+    if (job->status != JOB_STOPPED) {
+        printf("bg: job %d already in background\n", job_id);
+        return 0;
+    }
+    
+    // 更新作业状态
+    job_mark_running(job);
+    
+    // 发送SIGCONT信号继续运行作业
+    kill(-job->pgid, SIGCONT);
+    printf("[%d]+\tContinued\t%s\n", job->id, job->command);
+    return 0;
+}
+
+/**
+ * @brief parallel中正在运行的任务
+ */
+typedef struct {
+    pid_t pid;               // 0表示空闲
+    int index;               // 任务序号（从1开始，按输入顺序）
+    struct timespec start;   // 启动时间
+    char *text;              // 任务的输入行，用于报告
+} ParallelTask;
+
+/**
+ * @brief 计算两个时间点之间的秒数
+ */
+double elapsed_seconds(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief 把输入行拆成单词，和基础参数拼成任务的参数列表（分配在行内存池中）
+ *
+ * 基础参数中的"{}"替换为整行，没有"{}"时把各个单词追加在后面。
+ */
+char **parallel_build_argv(char **base, int nbase, char *line) {
+    int has_placeholder = 0;
+    for (int i = 0; i < nbase; i++) {
+        if (strcmp(base[i], "{}") == 0) has_placeholder = 1;
+    }
+    
+    int nwords = 0;
+    char **words = NULL;
+    if (!has_placeholder) {
+        words = arena_alloc(&line_arena, (strlen(line) / 2 + 1) * sizeof(char *));
+        for (char *word = strtok(line, " \t"); word; word = strtok(NULL, " \t")) {
+            words[nwords++] = word;
+        }
+    }
+    
+    char **argv = arena_alloc(&line_arena, (nbase + nwords + 1) * sizeof(char *));
+    int argc = 0;
+    for (int i = 0; i < nbase; i++) {
+        argv[argc++] = strcmp(base[i], "{}") == 0 ? line : base[i];
+    }
+    for (int i = 0; i < nwords; i++) {
+        argv[argc++] = words[i];
+    }
+    argv[argc] = NULL;
+    return argv;
+}
+
+/**
+ * @brief 启动一个parallel任务，找不到命令或启动失败时返回-1
+ */
+pid_t parallel_launch(char **argv) {
+    LaunchSpec spec = {0};
+    spec.argv = argv;
+    spec.pgid = -1; // 留在parallel的进程组中，整批任务一起接受作业控制
+    spec.path = lookup_command(argv[0]);
+    if (!spec.path) {
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        errno = ENOENT;
+        return -1;
+    }
+    return launch_process(&spec);
+}
+
+/**
+ * @brief 报告一个任务的结果
+ */
+void parallel_report(const ParallelTask *task, int code, const struct timespec *end,
+                     const struct rusage *usage) {
+    fprintf(stderr, "[%d]\texit %d\t%.3fs\tuser %.3fs\tsys %.3fs\t%s\n", task->index, code,
+            elapsed_seconds(&task->start, end), timeval_seconds(&usage->ru_utime),
+            timeval_seconds(&usage->ru_stime), task->text);
+}
+
+/**
+ * @brief parallel [-j N] [-a file] command [args...]
+ *
+ * 从标准输入（或-a指定的文件）每行读取一组参数，最多同时运行N个任务，
+ * 任一任务结束立即启动下一个。每个任务结束时在标准错误上报告退出码和耗时。
+ * 作为subshell内置命令在fork出的子进程中运行，整批任务属于同一个作业。
+ * @return 失败的任务数（最多101）
+ */
+int cmd_parallel(int argc, char **argv) {
+    int max_running = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *input = NULL;
+    
+    optind = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "+j:a:")) != -1) {
+        switch (opt) {
+            case 'j': max_running = atoi(optarg); break;
+            case 'a': input = optarg; break;
+            default:
+                fprintf(stderr, "usage: parallel [-j N] [-a file] command [args...]\n");
+                return EXIT_USAGE;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: parallel [-j N] [-a file] command [args...]\n");
+        return EXIT_USAGE;
+    }
+    if (max_running < 1) {
+        max_running = 1;
+    }
+    
+    // 在子进程中运行：不使用shell的事件循环和终端
+    close(epoll_fd);
+    close(sigchld_fd);
+    epoll_fd = sigchld_fd = input_fd = -1;
+    shell_is_interactive = 0;
+    
+    LineReader reader;
+    if (input) {
+        int fd = open(input, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror(input);
+            return 1;
+        }
+        reader_init_fd(&reader, fd);
+    } else {
+        reader_init_fd(&reader, STDIN_FILENO);
+    }
+    
+    // 基础参数复制出来，之后每启动一个任务就可以重置行内存池
+    int nbase = argc - optind;
+    char **base = malloc(nbase * sizeof(char *));
+    ParallelTask *tasks = calloc(max_running, sizeof(ParallelTask));
+    if (!base || !tasks) {
+        perror("malloc");
+        return 1;
+    }
+    for (int i = 0; i < nbase; i++) {
+        base[i] = strdup(argv[optind + i]);
+    }
+    arena_reset(&line_arena);
+    
+    struct timespec batch_start, now;
+    clock_gettime(CLOCK_MONOTONIC, &batch_start);
+    int running = 0, total = 0, failed = 0, eof = 0;
+    
+    while (running > 0 || !eof) {
+        // 有空位就启动新任务
+        while (!eof && running < max_running) {
+            char *line = reader_next_line(&reader);
+            if (!line) {
+                eof = 1;
+                break;
+            }
+            if (line[strspn(line, " \t")] == '\0') {
+                continue;
+            }
+            
+            ParallelTask *task = tasks;
+            while (task->pid != 0) task++;
+            task->index = ++total;
+            task->text = strdup(line);
+            clock_gettime(CLOCK_MONOTONIC, &task->start);
+            
+            pid_t pid = parallel_launch(parallel_build_argv(base, nbase, line));
+            arena_reset(&line_arena);
+            if (pid == -1) {
+                struct rusage none = {0};
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                parallel_report(task, launch_failure_status(), &now, &none);
+                free(task->text);
+                failed++;
+                continue;
+            }
+            task->pid = pid;
+            running++;
+        }
+        if (running == 0) {
+            continue;
+        }
+        
+        // 等待任一任务结束，腾出的位置在下一轮立即使用
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if (pid == -1) {
+            if (errno == EINTR) continue;
+            perror("wait4");
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        for (int i = 0; i < max_running; i++) {
+            if (tasks[i].pid == pid) {
+                int code = exit_status(status);
+                parallel_report(&tasks[i], code, &now, &usage);
+                if (code != 0) failed++;
+                free(tasks[i].text);
+                tasks[i].pid = 0;
+                running--;
+                break;
+            }
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(stderr, "parallel: %d tasks, %d failed, %.3fs\n", total, failed,
+            elapsed_seconds(&batch_start, &now));
+    return failed > 101 ? 101 : failed;
+}
+
+/**
+ * @brief shellstat：打印各阶段延迟的p50/p99/最大值（微秒）
+ *
+ * shellstat -r 清空统计；shellstat -t file [N] 把最近N行命令的追踪事件
+ * 导出为Chrome trace-event JSON（可在chrome://tracing或Perfetto中查看）。
+ * 统计需要先用 set -o stats=on 打开。
+ */
+int cmd_shellstat(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-r") == 0) {
+        memset(stat_hist, 0, sizeof(stat_hist));
+        trace_next = 0;
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "-t") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "usage: shellstat [-r | -t file [N]]\n");
+            return EXIT_USAGE;
+        }
+        return stat_dump_trace(argv[2], argc > 3 ? strtoul(argv[3], NULL, 10) : TRACE_LINES);
+    }
+    if (!stats_enabled) {
+        printf("(statistics are off, enable with: set -o stats=on)\n");
+    }
+    
+    printf("%-10s %10s %10s %10s %10s\n", "phase", "count", "p50(us)", "p99(us)", "max(us)");
+    for (int i = 0; i < NUM_STATS; i++) {
+        Histogram *hist = &stat_hist[i];
+        if (hist->count == 0) {
+            continue;
+        }
+        printf("%-10s %10lu %10.1f %10.1f %10.1f\n", stat_names[i], hist->count,
+               stat_percentile(hist, 0.5) / 1e3, stat_percentile(hist, 0.99) / 1e3,
+               hist->max / 1e3);
+    }
+    return 0;
+}
+
+/**
+ * @brief 执行hash命令：无参数时列出缓存及命中次数，-r清空，其余参数加入缓存
+ */
+int cmd_hash(int argc, char **argv) {
+    hash_check_path();
+
+    if (argc < 2) {
+        int empty = 1;
+        for (int i = 0; i < HASH_BUCKETS; i++) {
+            for (HashEntry *entry = hash_table[i]; entry; entry = entry->next) {
+                if (empty) {
+                    printf("hits\tcommand\n");
+                    empty = 0;
+                }
+                printf("%4d\t%s\n", entry->hits, entry->path);
+            }
+        }
+        if (empty) {
+            printf("hash: hash table empty\n");
+        }
+        return 0;
+    }
+
+    int ret = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            hash_clear();
+        } else if (!strchr(argv[i], '/') && !hash_insert(argv[i])) {
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief history [N]：列出全部或最近N条记录；history -s 文本：从新到旧列出包含文本的记录
+ */
+int cmd_history(int argc, char **argv) {
+    if (history_sync() != 0) {
+        fprintf(stderr, "history: %s\n", strerror(errno));
+        return 1;
+    }
+    size_t len;
+    if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+        for (int i = history_search(argv[2], -1); i >= 0; i = history_search(argv[2], i)) {
+            const char *text = history_entry(i, &len);
+            printf("%5d  %.*s\n", i + 1, (int)len, text);
+        }
+        return 0;
+    }
+    
+    int n = history.count;
+    if (argc == 2) {
+        char *end;
+        n = strtol(argv[1], &end, 10);
+        if (*end != '\0' || n < 0) {
+            fprintf(stderr, "history: %s: numeric argument required\n", argv[1]);
+            return EXIT_USAGE;
+        }
+    } else if (argc > 2) {
+        fprintf(stderr, "usage: history [N] | history -s text\n");
+        return EXIT_USAGE;
+    }
+    for (int i = n < history.count ? history.count - n : 0; i < history.count; i++) {
+        const char *text = history_entry(i, &len);
+        printf("%5d  %.*s\n", i + 1, (int)len, text);
+    }
+    return 0;
+}
+
+/**
+ * @brief 设置选项，arg形如name=value
+ */
+int set_option(const char *arg) {
+    const char *eq = strchr(arg, '=');
+    size_t len = eq ? (size_t)(eq - arg) : strlen(arg);
+    
+    for (int i = 0; i < NUM_OPTIONS; i++) {
+        ShellOption *opt = &shell_options[i];
+        if (strlen(opt->name) != len || strncmp(opt->name, arg, len) != 0) {
+            continue;
+        }
+        if (!eq) {
+            fprintf(stderr, "set: %s: value required\n", opt->name);
+            return -1;
+        }
+        if (opt->parse) {
+            if (opt->parse(eq + 1, opt->value) == 0) {
+                return 0;
+            }
+            fprintf(stderr, "set: %s: invalid value: %s\n", opt->name, eq + 1);
+            return -1;
+        }
+        for (int j = 0; opt->choices[j]; j++) {
+            if (strcmp(opt->choices[j], eq + 1) == 0) {
+                *opt->value = j;
+                return 0;
+            }
+        }
+        fprintf(stderr, "set: %s: invalid value: %s\n", opt->name, eq + 1);
+        return -1;
+    }
+    fprintf(stderr, "set: %.*s: invalid option name\n", (int)len, arg);
+    return -1;
+}
+
+/**
+ * @brief 执行set命令：set -o 列出选项，set -o name=value 设置选项
+ */
+int cmd_set(int argc, char **argv) {
+    if (argc < 2 || (argc == 2 && strcmp(argv[1], "-o") == 0)) {
+        for (int i = 0; i < NUM_OPTIONS; i++) {
+            ShellOption *opt = &shell_options[i];
+            int nchoices = 0;
+            while (opt->choices[nchoices]) nchoices++;
+            if (opt->format) {
+                printf("%-15s\t%s\n", opt->name, opt->format(*opt->value));
+            } else if (*opt->value < nchoices) {
+                printf("%-15s\t%s\n", opt->name, opt->choices[*opt->value]);
+            } else {
+                printf("%-15s\t%d\n", opt->name, *opt->value);
+            }
+        }
+        return 0;
+    }
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0) continue;
+        if (set_option(argv[i]) != 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 按名字比较两个"名字=值"
+ */
+int compare_entries(const void *a, const void *b) {
+    const unsigned char *x = *(const unsigned char *const *)a;
+    const unsigned char *y = *(const unsigned char *const *)b;
+    while (*x == *y && *x != '=') {
+        x++;
+        y++;
+    }
+    return (*x == '=' ? 0 : *x) - (*y == '=' ? 0 : *y);
+}
+
+/**
+ * @brief 执行export命令：不带参数时按名字列出导出变量，
+ * export name[=value] 导出变量（可同时赋值）
+ */
+int cmd_export(int argc, char **argv) {
+    if (argc < 2 || (argc == 2 && strcmp(argv[1], "-p") == 0)) {
+        char **envp = var_environ();
+        int n = 0;
+        while (envp[n]) n++;
+        char **sorted = arena_alloc(&line_arena, n * sizeof(char *));
+        memcpy(sorted, envp, n * sizeof(char *));
+        qsort(sorted, n, sizeof(char *), compare_entries);
+        for (int i = 0; i < n; i++) {
+            const char *eq = strchr(sorted[i], '=');
+            printf("declare -x %.*s=\"", (int)(eq - sorted[i]), sorted[i]);
+            for (const char *c = eq + 1; *c; c++) {
+                if (strchr("\"\\$`", *c)) putchar('\\');
+                putchar(*c);
+            }
+            printf("\"\n");
+        }
+        return 0;
+    }
+    
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *eq = strchr(argv[i], '=');
+        size_t len = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+        if (!var_name_valid(argv[i], len)) {
+            fprintf(stderr, "export: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        if (eq) {
+            var_set(argv[i], len, eq + 1, 1);
+        } else {
+            const char *value = var_get_n(argv[i], len);
+            var_set(argv[i], len, value, 1);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief 执行unset命令：删除变量
+ */
+int cmd_unset(int argc, char **argv) {
+    int status = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!var_name_valid(argv[i], strlen(argv[i]))) {
+            fprintf(stderr, "unset: `%s': not a valid identifier\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        var_set(argv[i], strlen(argv[i]), NULL, 0);
+    }
+    return status;
+}
+
+/**
+ * @brief 执行cd命令
+ */
+int cmd_cd(const char *path) {
+    if (!path || strcmp(path, "") == 0) {
+        // 默认切换到HOME目录
+        const char *home = var_get("HOME");
+        if (!home) {
+            fprintf(stderr, "cd: HOME not set\n");
+            return 1;
+        }
+        path = home;
+    }
+    
+    if (chdir(path) != 0) {
+        perror("cd");
+        return 1;
+    }
+    refresh_prompt();
+    return 0;
+}
+
+/**
+ * @brief 解析作业号参数，支持%前缀，缺省为-1
+ */
+int parse_job_id(const char *arg) {
+    if (!arg) return -1;
+    if (arg[0] == '%') return atoi(arg + 1);
+    return atoi(arg);
+}
+
+int builtin_cd(int argc, char **argv) {
+    return cmd_cd(argc > 1 ? argv[1] : NULL);
+}
+
+int builtin_exit(int argc, char **argv) {
+    exit(argc > 1 ? atoi(argv[1]) : last_status);
+}
+
+int builtin_fg(int argc, char **argv) {
+    return cmd_fg(parse_job_id(argc > 1 ? argv[1] : NULL));
+}
+
+int builtin_bg(int argc, char **argv) {
+    return cmd_bg(parse_job_id(argc > 1 ? argv[1] : NULL));
+}
+
+// 内置命令表，pwd/clear/ls/cat来自mybin
+Builtin builtins[] = {
+    {"cd",    builtin_cd},
+    {"exit",  builtin_exit},
+    {"jobs",  cmd_jobs, BUILTIN_SHELL, 1},
+    {"fg",    builtin_fg},
+    {"bg",    builtin_bg},
+    {"hash",  cmd_hash},
+    {"set",   cmd_set},
+    {"export", cmd_export},
+    {"unset", cmd_unset},
+    {"pwd",   mybin_pwd, BUILTIN_SHELL, 1},
+    {"clear", mybin_clear, BUILTIN_SHELL, 1},
+    {"ls",    mybin_ls, BUILTIN_WALK},
+    {"shellstat", cmd_shellstat},
+    {"history", cmd_history, BUILTIN_SHELL, 1},
+    {"parallel", cmd_parallel, BUILTIN_SUBSHELL},
+    {"cat",   mybin_cat, BUILTIN_FILTER},
+};
+#define NUM_BUILTINS (int)(sizeof(builtins) / sizeof(builtins[0]))
+
+/**
+ * @brief 查找内置命令
+ */
+Builtin *find_builtin(const char *name) {
+    for (int i = 0; i < NUM_BUILTINS; i++) {
+        if (strcmp(builtins[i].name, name) == 0) {
+            return &builtins[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 在shell进程中应用重定向，原来的描述符保存在saved中以便恢复
+ * @return 成功返回已应用的重定向数，失败返回-1（已恢复并报告错误）
+ */
+int apply_redirects(const Stage *stage, int *saved) {
+    int n = 0;
+    for (Redirect *redir = stage->redirects; redir; redir = redir->next) {
+        int fd = -1;
+        if (redir->type == REDIR_FILE) {
+            fd = open(redir->path, redir->flags | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                perror(redir->path);
+                restore_redirects(stage, saved, n);
+                return -1;
+            }
+        } else if (redir->type == REDIR_DUP && fcntl(redir->src, F_GETFD) == -1) {
+            fprintf(stderr, "mybash: %d: %s\n", redir->src, strerror(errno));
+            restore_redirects(stage, saved, n);
+            return -1;
+        }
+        // 目标描述符原本未打开时记为-1，恢复时直接关闭
+        saved[n] = fcntl(redir->fd, F_DUPFD_CLOEXEC, 10);
+        if (redir->type == REDIR_FILE) {
+            dup2(fd, redir->fd);
+            close(fd);
+        } else if (redir->type == REDIR_DUP) {
+            dup2(redir->src, redir->fd);
+        } else {
+            close(redir->fd);
+        }
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief 按相反顺序恢复apply_redirects保存的描述符
+ */
+void restore_redirects(const Stage *stage, int *saved, int n) {
+    fflush(stdout);
+    fflush(stderr);
+    
+    // 重定向记录是单链表，先收集到数组中再倒序恢复
+    Redirect **list = arena_alloc(&line_arena, (n + 1) * sizeof(Redirect *));
+    Redirect *redir = stage->redirects;
+    for (int i = 0; i < n; i++, redir = redir->next) {
+        list[i] = redir;
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        if (saved[i] >= 0) {
+            dup2(saved[i], list[i]->fd);
+            close(saved[i]);
+        } else {
+            close(list[i]->fd);
+        }
+    }
+}
+
+/**
+ * @brief filter内置命令只实现了不带选项的用法，其余交给外部命令
+ */
+int filter_supported(char **argv) {
+    for (int i = 1; argv[i]; i++) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief filter内置命令能否直接在shell中执行
+ *
+ * 要求是前台命令、标准输出重定向到文件、输入全部是命名的普通文件：
+ * 这时数据量有限且不经过终端，不需要Ctrl+C/Ctrl+Z，省掉整个fork+exec。
+ * 其他情况在子进程中运行，仍然省掉exec。
+ */
+int filter_in_shell(const Stage *stage, int background) {
+    if (background || stage->argc < 2 || !filter_supported(stage->argv)) {
+        return 0;
+    }
+    int to_file = 0;
+    for (Redirect *redir = stage->redirects; redir; redir = redir->next) {
+        if (redir->fd == STDOUT_FILENO) {
+            to_file = redir->type == REDIR_FILE;
+        }
+    }
+    if (!to_file) {
+        return 0;
+    }
+    struct stat st;
+    for (int i = 1; i < stage->argc; i++) {
+        if (stat(stage->argv[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 处理内置命令，退出状态记录在last_status中
+ *
+ * 内置命令在shell进程中执行，重定向通过保存和恢复描述符实现，不创建子进程。
+ * @return 是内置命令时返回1
+ */
+int handle_builtin_commands(Stage *stage, int background) {
+    Builtin *builtin = find_builtin(stage->argv[0]);
+    if (!builtin || builtin->place == BUILTIN_SUBSHELL ||
+        (builtin->place == BUILTIN_FILTER && !filter_in_shell(stage, background)) ||
+        (builtin->place == BUILTIN_WALK && mybin_ls_recursive(stage->argv))) {
+        return 0; // 不是内置命令，或者需要作为作业在子进程中运行
+    }
+    
+    int nredirects = 0;
+    for (Redirect *redir = stage->redirects; redir; redir = redir->next) {
+        nredirects++;
+    }
+    int *saved = arena_alloc(&line_arena, (nredirects + 1) * sizeof(int));
+    
+    // 先刷出缓冲区，避免之前的输出被写进重定向的文件
+    fflush(stdout);
+    if (builtin->place == BUILTIN_FILTER) {
+        reader_sync(shared_input); // cat等在shell中读取标准输入
+    }
+    int applied = apply_redirects(stage, saved);
+    if (applied < 0) {
+        last_status = 1;
+        return 1;
+    }
+    
+    unsigned long long t = stat_now();
+    last_status = builtin->func(stage->argc, stage->argv);
+    stat_record(STAT_BUILTIN, t);
+    restore_redirects(stage, saved, applied);
+    return 1;
+}
+
+
+/**********************************************************************
+ * 通配符展开
+ *
+ * 含未加引号的*、?、[...]的单词在解析时展开为匹配的路径，按字节序排序；
+ * 没有匹配时保留原样。**作为完整的一段时匹配零层或多层子目录（不进入
+ * 隐藏目录，不跟随符号链接）。*、?、[开头的段不匹配以.开头的名字。
+ *
+ * 模式按/分段编译一次：每段是固定文本、?、字符集合和*组成的序列，
+ * *之间的各组宽度固定，匹配时开头和结尾的组直接比较，中间的组依次
+ * 向后查找最左的位置，不需要回溯。目录用getdents64读取，类型由d_type
+ * 给出；需要进入的子目录直接openat(O_DIRECTORY)，不是目录时打开失败，
+ * 不对目录项调用stat。结果分配在line_arena中。
+ **********************************************************************/
+
+/**
+ * @brief 解析[...]，把集合写入256位的位图
+ * @return 指向]之后的位置，没有]时返回NULL（按普通字符处理）
+ */
+const char *glob_parse_class(const char *p, uint8_t *set) {
+    static const struct {
+        const char *name;
+        int (*test)(int);
+    } classes[] = {
+        {"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum}, {"upper", isupper},
+        {"lower", islower}, {"space", isspace}, {"punct", ispunct}, {"xdigit", isxdigit},
+    };
+    int negate = *p == '!' || *p == '^';
+    if (negate) p++;
+    memset(set, 0, 32);
+    int first = 1;
+    while (*p && (*p != ']' || first)) {
+        first = 0;
+        if (p[0] == '[' && p[1] == ':') {
+            const char *end = strstr(p + 2, ":]");
+            size_t len = end ? (size_t)(end - p - 2) : 0;
+            int found = 0;
+            for (size_t k = 0; end && k < sizeof(classes) / sizeof(classes[0]); k++) {
+                if (strlen(classes[k].name) == len && strncmp(p + 2, classes[k].name, len) == 0) {
+                    for (int c = 1; c < 256; c++) {
+                        if (classes[k].test(c)) set[c >> 3] |= 1 << (c & 7);
+                    }
+                    found = 1;
+                }
+            }
+            if (found) {
+                p = end + 2;
+                continue;
+            }
+        }
+        unsigned char lo = *p++;
+        if (lo == '\\' && *p) lo = *p++;
+        unsigned char hi = lo;
+        if (p[0] == '-' && p[1] && p[1] != ']') {
+            p++;
+            hi = *p++;
+            if (hi == '\\' && *p) hi = *p++;
+        }
+        for (int c = lo; c <= hi; c++) {
+            set[c >> 3] |= 1 << (c & 7);
+        }
+    }
+    if (*p != ']') {
+        return NULL;
+    }
+    if (negate) {
+        for (int i = 0; i < 32; i++) set[i] = ~set[i];
+    }
+    set[0] &= ~1; // '\0'不会出现在名字中
+    return p + 1;
+}
+
+/**
+ * @brief 编译一段模式（不含/）
+ * @return 段中有通配符返回1，只有固定文本返回0（seg->literal为去掉转义的名字）
+ */
+int glob_compile_segment(const char *text, size_t len, GlobSegment *seg) {
+    char *src = arena_alloc(&line_arena, len + 1);
+    memcpy(src, text, len);
+    src[len] = '\0';
+    // 每个字符至多产生一个操作，固定文本连续存放在lit中
+    GlobOp *ops = arena_alloc(&line_arena, (len + 1) * sizeof(GlobOp));
+    char *lit = arena_alloc(&line_arena, len + 1);
+    int nops = 0, wild = 0;
+    
+    memset(seg, 0, sizeof(*seg));
+    seg->recursive = strcmp(src, "**") == 0;
+    seg->dot = src[0] == '.' || (src[0] == '\\' && src[1] == '.');
+    for (const char *p = src; *p;) {
+        GlobOp *op = &ops[nops];
+        if (*p == '*') {
+            while (*p == '*') p++;
+            op->type = PAT_STAR;
+            nops++;
+            wild = 1;
+            continue;
+        }
+        if (*p == '?') {
+            p++;
+            op->type = PAT_ANY;
+            op->width = 1;
+            nops++;
+            wild = 1;
+            continue;
+        }
+        if (*p == '[') {
+            uint8_t *set = arena_alloc(&line_arena, 32);
+            const char *end = glob_parse_class(p + 1, set);
+            if (end) {
+                p = end;
+                op->type = PAT_CLASS;
+                op->set = set;
+                op->width = 1;
+                nops++;
+                wild = 1;
+                continue;
+            }
+        }
+        // 固定文本：与前一个固定文本操作合并
+        if (*p == '\\' && p[1]) p++;
+        if (nops > 0 && ops[nops - 1].type == PAT_LITERAL) {
+            ops[nops - 1].width++;
+        } else {
+            op->type = PAT_LITERAL;
+            op->text = lit;
+            op->width = 1;
+            nops++;
+        }
+        *lit++ = *p++;
+    }
+    *lit = '\0';
+    seg->ops = ops;
+    seg->nops = nops;
+    if (!wild) {
+        seg->literal = nops ? ops[0].text : "";
+    }
+    return wild;
+}
+
+/**
+ * @brief 编译整个模式
+ * @return 含通配符返回0，没有通配符（不需要展开）返回-1
+ */
+int glob_compile(const char *pattern, GlobPattern *pat) {
+    int cap = 1;
+    for (const char *p = pattern; *p; p++) cap += *p == '/';
+    pat->segs = arena_alloc(&line_arena, cap * sizeof(GlobSegment));
+    pat->nsegs = 0;
+    pat->absolute = pattern[0] == '/';
+    pat->dir_only = 0;
+    int wild = 0;
+    const char *p = pattern;
+    while (*p) {
+        while (*p == '/') p++;
+        if (*p == '\0') {
+            pat->dir_only = pat->nsegs > 0;
+            break;
+        }
+        const char *end = strchr(p, '/');
+        if (!end) end = p + strlen(p);
+        wild |= glob_compile_segment(p, end - p, &pat->segs[pat->nsegs++]);
+        p = end;
+    }
+    return wild && pat->nsegs > 0 ? 0 : -1;
+}
+
+/**
+ * @brief 在name处匹配一组宽度固定的操作
+ */
+static inline int glob_match_fixed(const GlobOp *ops, int n, const char *name) {
+    for (int i = 0; i < n; i++) {
+        const GlobOp *op = &ops[i];
+        unsigned char c = *name;
+        if (op->type == PAT_LITERAL) {
+            if (memcmp(name, op->text, op->width) != 0) return 0;
+        } else if (op->type == PAT_CLASS && !(op->set[c >> 3] & (1 << (c & 7)))) {
+            return 0;
+        }
+        name += op->width;
+    }
+    return 1;
+}
+
+/**
+ * @brief 用编译好的段匹配一个名字
+ *
+ * 操作序列被*分成若干组，每组宽度固定：第一组（第一个*之前）必须
+ * 在开头，最后一组（最后一个*之后）必须在结尾，中间的组依次取最左的
+ * 匹配位置，贪心即可得到正确结果。
+ */
+int glob_match(const GlobSegment *seg, const char *name, size_t len) {
+    if (name[0] == '.' && !seg->dot) {
+        return 0;
+    }
+    const GlobOp *ops = seg->ops;
+    int n = seg->nops;
+    
+    // 开头的组
+    int i = 0;
+    size_t width = 0;
+    while (i < n && ops[i].type != PAT_STAR) width += ops[i++].width;
+    if (width > len || !glob_match_fixed(ops, i, name)) return 0;
+    if (i == n) return width == len;
+    size_t pos = width;
+    
+    // 结尾的组
+    int j = n;
+    size_t tail = 0;
+    while (ops[j - 1].type != PAT_STAR) tail += ops[--j].width;
+    if (pos + tail > len || !glob_match_fixed(ops + j, n - j, name + len - tail)) return 0;
+    size_t limit = len - tail;
+    
+    // 中间各组：ops[i]是*，之后到下一个*为一组
+    while (++i < j) {
+        int start = i;
+        width = 0;
+        while (ops[i].type != PAT_STAR) width += ops[i++].width;
+        if (start + 1 == i && ops[start].type == PAT_LITERAL) {
+            // 单独的固定文本用memmem查找
+            const char *hit = memmem(name + pos, limit - pos, ops[start].text, width);
+            if (!hit) return 0;
+            pos = hit - name + width;
+            continue;
+        }
+        while (pos + width <= limit && !glob_match_fixed(ops + start, i - start, name + pos)) pos++;
+        if (pos + width > limit) return 0;
+        pos += width;
+    }
+    return 1;
+}
+
+/**
+ * @brief 加入一个结果：当前目录前缀加名字
+ */
+void glob_add(GlobState *st, const char *name, size_t len) {
+    if (st->count == st->cap) {
+        int cap = st->cap ? st->cap * 2 : 64;
+        char **paths = arena_alloc(&line_arena, cap * sizeof(char *));
+        if (st->count) memcpy(paths, st->paths, st->count * sizeof(char *));
+        st->paths = paths;
+        st->cap = cap;
+    }
+    int slash = st->pat->dir_only;
+    char *path = arena_alloc(&line_arena, st->path_len + len + slash + 1);
+    memcpy(path, st->path, st->path_len);
+    memcpy(path + st->path_len, name, len);
+    if (slash) path[st->path_len + len] = '/';
+    path[st->path_len + len + slash] = '\0';
+    st->paths[st->count++] = path;
+}
+
+void glob_dir(GlobState *st, int seg, int dirfd);
+
+/**
+ * @brief 记下一个要进入的子目录
+ */
+void glob_queue_push(GlobQueue *queue, const char *name, int seg) {
+    if (queue->count == queue->cap) {
+        int cap = queue->cap ? queue->cap * 2 : 16;
+        char **names = arena_alloc(&line_arena, cap * sizeof(char *));
+        int *segs = arena_alloc(&line_arena, cap * sizeof(int));
+        if (queue->count) {
+            memcpy(names, queue->names, queue->count * sizeof(char *));
+            memcpy(segs, queue->segs, queue->count * sizeof(int));
+        }
+        queue->names = names;
+        queue->segs = segs;
+        queue->cap = cap;
+    }
+    queue->names[queue->count] = arena_strdup(&line_arena, name);
+    queue->segs[queue->count++] = seg;
+}
+
+/**
+ * @brief 进入子目录name，在其中匹配第seg段
+ *
+ * nofollow时不跟随符号链接（**的递归）。打开失败（不是目录、没有权限）时跳过。
+ */
+void glob_descend(GlobState *st, int seg, int dirfd, const char *name, int nofollow) {
+    size_t len = strlen(name);
+    if (st->path_len + len + 2 > sizeof(st->path)) {
+        return;
+    }
+    int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (nofollow ? O_NOFOLLOW : 0));
+    if (fd < 0) {
+        return;
+    }
+    size_t saved = st->path_len;
+    memcpy(st->path + st->path_len, name, len);
+    st->path_len += len;
+    st->path[st->path_len++] = '/';
+    glob_dir(st, seg, fd);
+    st->path_len = saved;
+    close(fd);
+}
+
+/**
+ * @brief 目录项是否是目录（只有d_type不确定时才stat）
+ */
+int glob_is_dir(int dirfd, const char *name, unsigned char type) {
+    if (type == DT_DIR) return 1;
+    if (type != DT_LNK && type != DT_UNKNOWN) return 0;
+    struct stat sb;
+    return fstatat(dirfd, name, &sb, 0) == 0 && S_ISDIR(sb.st_mode);
+}
+
+/**
+ * @brief 在dirfd中匹配第seg段，以及其后的各段
+ *
+ * 先读完整个目录，把需要进入的子目录记下来，再逐个进入，
+ * 同一时间只使用一个getdents64缓冲区。
+ */
+void glob_dir(GlobState *st, int seg, int dirfd) {
+    const GlobPattern *pat = st->pat;
+    if (seg == pat->nsegs) {
+        // 模式以**结尾时的目录本身已经在上一层加入
+        return;
+    }
+    const GlobSegment *s = &pat->segs[seg];
+    int last = seg == pat->nsegs - 1;
+    if (s->literal && !s->recursive) {
+        if (!last) {
+            glob_descend(st, seg + 1, dirfd, s->literal, 0);
+            return;
+        }
+        struct stat sb;
+        if (fstatat(dirfd, s->literal, &sb, pat->dir_only ? 0 : AT_SYMLINK_NOFOLLOW) == 0 &&
+            (!pat->dir_only || S_ISDIR(sb.st_mode))) {
+            glob_add(st, s->literal, strlen(s->literal));
+        }
+        return;
+    }
+    
+    // **：本层按下一段匹配，同时进入每个非隐藏的子目录继续按**匹配
+    const GlobSegment *match = s;
+    int match_seg = seg;
+    if (s->recursive) {
+        match_seg = seg + 1;
+        match = match_seg < pat->nsegs ? &pat->segs[match_seg] : NULL;
+        if (match && match->recursive) {
+            glob_dir(st, match_seg, dirfd); // **/**等同于**
+            return;
+        }
+    }
+    int match_last = match_seg == pat->nsegs - 1;
+    
+    GlobQueue queue = {0}; // 需要进入的子目录
+    ssize_t n;
+    while ((n = getdents64(dirfd, st->dents, DENTS_BUF_SIZE)) > 0) {
+        for (ssize_t off = 0; off < n;) {
+            struct dirent64 *d = (struct dirent64 *)(st->dents + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            size_t len = strlen(name);
+            if (!match) {
+                // 模式以**结尾：所有非隐藏的项
+                if (name[0] != '.' && (!pat->dir_only || glob_is_dir(dirfd, name, d->d_type))) {
+                    glob_add(st, name, len);
+                }
+            } else if (match->literal ? strcmp(name, match->literal) == 0 : glob_match(match, name, len)) {
+                if (!match_last) {
+                    // 符号链接和类型未知的项交给openat判断是不是目录
+                    if (d->d_type == DT_DIR || d->d_type == DT_LNK || d->d_type == DT_UNKNOWN) {
+                        glob_queue_push(&queue, name, match_seg + 1);
+                    }
+                } else if (!pat->dir_only || glob_is_dir(dirfd, name, d->d_type)) {
+                    glob_add(st, name, len);
+                }
+            }
+            if (s->recursive && name[0] != '.' && (d->d_type == DT_DIR || d->d_type == DT_UNKNOWN)) {
+                glob_queue_push(&queue, name, seg);
+            }
+        }
+    }
+    
+    for (int i = 0; i < queue.count; i++) {
+        int recurse = s->recursive && queue.segs[i] == seg;
+        glob_descend(st, queue.segs[i], dirfd, queue.names[i], recurse);
+    }
+}
+
+int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief 按字节序排序展开结果
+ *
+ * 同一目录的大量名字有很长的共同前缀，qsort的每次strcmp都要重复比较
+ * 这些字节。这里跳过所有路径的共同前缀，取之后的8个字节作为整数键做
+ * LSD基数排序（各路径都相同的字节跳过），只有键相同的区间才用strcmp排序。
+ */
+void glob_sort(char **paths, int n) {
+    if (n < 2) {
+        return; // 没有匹配时paths为NULL
+    }
+    if (n < 256) {
+        qsort(paths, n, sizeof(char *), compare_paths);
+        return;
+    }
+    size_t common = strlen(paths[0]);
+    for (int i = 1; i < n && common > 0; i++) {
+        size_t k = 0;
+        while (k < common && paths[i][k] == paths[0][k]) k++;
+        common = k;
+    }
+    GlobSortItem *items = arena_alloc(&line_arena, n * sizeof(GlobSortItem));
+    GlobSortItem *tmp = arena_alloc(&line_arena, n * sizeof(GlobSortItem));
+    for (int i = 0; i < n; i++) {
+        const unsigned char *s = (const unsigned char *)paths[i] + common;
+        uint64_t key = 0;
+        for (int b = 0; b < 8; b++) {
+            key = key << 8 | *s;
+            if (*s) s++;
+        }
+        items[i] = (GlobSortItem){key, paths[i]};
+    }
+    for (int shift = 0; shift < 64; shift += 8) {
+        int count[256] = {0};
+        for (int i = 0; i < n; i++) count[(items[i].key >> shift) & 0xff]++;
+        if (count[(items[0].key >> shift) & 0xff] == n) continue;
+        int pos = 0;
+        for (int b = 0; b < 256; b++) {
+            int c = count[b];
+            count[b] = pos;
+            pos += c;
+        }
+        for (int i = 0; i < n; i++) tmp[count[(items[i].key >> shift) & 0xff]++] = items[i];
+        GlobSortItem *swap = items;
+        items = tmp;
+        tmp = swap;
+    }
+    for (int i = 0; i < n;) {
+        int j = i;
+        for (; j < n && items[j].key == items[i].key; j++) paths[j] = items[j].path;
+        // 键的最后一个字节为0说明路径在键内结束，键相同即路径相同
+        if (j - i > 1 && (items[i].key & 0xff)) {
+            qsort(paths + i, j - i, sizeof(char *), compare_paths);
+        }
+        i = j;
+    }
+}
+
+/**
+ * @brief 展开通配符模式
+ * @param pattern 词法分析得到的模式（加引号的字符已用\转义）
+ * @param paths_out 排好序的匹配路径（分配在line_arena中）
+ * @return 匹配数，没有匹配或模式不含通配符时返回0
+ */
+int glob_expand(const char *pattern, char ***paths_out) {
+    GlobPattern pat;
+    if (glob_compile(pattern, &pat) != 0) {
+        return 0;
+    }
+    GlobState *st = arena_alloc(&line_arena, sizeof(GlobState));
+    st->pat = &pat;
+    st->paths = NULL;
+    st->count = st->cap = 0;
+    st->path_len = 0;
+    st->dents = arena_alloc(&line_arena, DENTS_BUF_SIZE);
+    if (pat.absolute) {
+        st->path[st->path_len++] = '/';
+    }
+    int fd = open(pat.absolute ? "/" : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    glob_dir(st, 0, fd);
+    close(fd);
+    
+    glob_sort(st->paths, st->count);
+    *paths_out = st->paths;
+    return st->count;
+}
+
+/**********************************************************************
+ * 命令提示符与解析
+ **********************************************************************/
+
+/**
+ * @brief 初始化提示符：用户名和主机名只在启动时查询一次
+ *
+ * getpwuid可能经过NSS/LDAP，耗时远超过一次按键的预算，因此不在每次提示时调用。
+ */
+void init_prompt() {
+    char *user_str = "$";
+    int user_id = getuid();
+    
+    // 检查是否是root用户
+    if (user_id == 0) {
+        user_str = "#";
+    }
+    
+    // 获取用户信息和主机名；任一失败时prompt_user留空，refresh_prompt使用默认提示符
+    struct passwd *ptr = getpwuid(user_id);
+    char hostname[128] = {0};
+    if (ptr && gethostname(hostname, sizeof(hostname) - 1) != -1) {
+        snprintf(prompt_user, sizeof(prompt_user), "\033[1;32m%s@%s\033[0m:\033[1;34m",
+                 ptr->pw_name, hostname);
+        snprintf(prompt_tail, sizeof(prompt_tail), "\033[0m%s ", user_str);
+    }
+    refresh_prompt();
+}
+
+/**
+ * @brief 重新获取当前工作目录并预先格式化整条提示符
+ *
+ * 只在启动和cd成功后调用。
+ */
+void refresh_prompt() {
+    char dir[PATH_MAX];
+    if (prompt_user[0] == '\0' || getcwd(dir, sizeof(dir)) == NULL) {
+        prompt_len = snprintf(prompt_buf, sizeof(prompt_buf), "mybash1.0>> ");
+        return;
+    }
+    
+    // 彩色提示符
+    int len = snprintf(prompt_buf, sizeof(prompt_buf), "%s%s%s",
+                       prompt_user, dir, prompt_tail);
+    if (len < 0 || (size_t)len >= sizeof(prompt_buf)) {
+        len = snprintf(prompt_buf, sizeof(prompt_buf), "mybash1.0>> ");
+    }
+    prompt_len = len;
+}
+
+/**
+ * @brief 打印命令提示符
+ *
+ * 先刷出stdio中尚未输出的内容以保证顺序，再用一次write输出整条提示符。
+ */
+void print_prompt() {
+    fflush(stdout);
+    if (write(STDOUT_FILENO, prompt_buf, prompt_len) < 0) {
+        return; // 终端不可写，随后读取输入时会得到EOF
+    }
+}
+
+/**
+ * @brief 报告语法错误
+ */
+void syntax_error(const Token *tok) {
+    static const char *const names[] = {NULL, "|", "&", "<", ">", ">>", "<&", ">&"};
+    fprintf(stderr, "mybash: syntax error near unexpected token `%s'\n",
+            tok ? names[tok->type] : "newline");
+}
+
+/**
+ * @brief 找到命令替换的结尾，p指向$(或`
+ *
+ * $(...)中可以有引号、转义和嵌套的替换，按括号层数找到对应的)。
+ * @return )或`之后的位置，没有结尾时返回NULL
+ */
+const char *substitution_end(const char *p) {
+    if (*p == '`') {
+        for (p++; *p != '`'; p++) {
+            if (*p == '\0') return NULL;
+            if (*p == '\\' && p[1]) p++;
+        }
+        return p + 1;
+    }
+    int depth = 0, dquote = 0;
+    for (p += 2; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+        } else if (*p == '\'' && !dquote) {
+            p = strchr(p + 1, '\'');
+            if (!p) return NULL;
+        } else if (*p == '"') {
+            dquote = !dquote;
+        } else if ((*p == '$' && p[1] == '(') || *p == '`') {
+            p = substitution_end(p);
+            if (!p) return NULL;
+            p--;
+        } else if (!dquote && *p == '(') {
+            depth++;
+        } else if (!dquote && *p == ')' && depth-- == 0) {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 执行p处的命令替换（$(...)或`...`），输出保存在out中
+ * @return 替换之后的位置，没有结尾时报告错误并返回NULL
+ */
+const char *substitute(const char *p, Capture *out) {
+    const char *end = substitution_end(p);
+    if (!end) {
+        fprintf(stderr, "mybash: unexpected EOF while looking for matching `%c'\n",
+                *p == '`' ? '`' : ')');
+        return NULL;
+    }
+    char *body;
+    if (*p == '`') {
+        // 反引号内的\`、\\和\$去掉反斜杠
+        char *b = body = arena_alloc(&line_arena, end - p);
+        for (const char *c = p + 1; c < end - 1; c++) {
+            if (*c == '\\' && (c[1] == '`' || c[1] == '\\' || c[1] == '$')) c++;
+            *b++ = *c;
+        }
+        *b = '\0';
+    } else {
+        size_t len = end - p - 3;
+        body = arena_alloc(&line_arena, len + 1);
+        memcpy(body, p + 2, len);
+        body[len] = '\0';
+    }
+    capture_command(body, out);
+    return end;
+}
+
+/**
+ * @brief 释放一行中各命令替换的输出
+ */
+void captures_free(Capture *capture) {
+    for (; capture; capture = capture->next) {
+        free(capture->buf);
+    }
+}
+
+/**
+ * @brief 统计行中$引用和命令替换的值的总长度（单引号内不展开），用来确定单词缓冲区的大小
+ *
+ * 命令替换在这里按出现顺序执行，输出依次记在captures中，由tokenize取用。
+ * @return 总长度，引用不合法或替换没有结尾时返回-1（已报告）
+ */
+long expansion_length(const char *line, Capture **captures) {
+    long total = 0;
+    int dquote = 0;
+    const char *p = line;
+    Capture **tail = captures;
+    *captures = NULL;
+    while (*p) {
+        if (*p == '\'' && !dquote) {
+            const char *close = strchr(p + 1, '\'');
+            if (!close) break; // 引号不匹配由tokenize报告
+            p = close + 1;
+        } else if (*p == '\\' && p[1]) {
+            p += 2;
+        } else if ((*p == '$' && p[1] == '(') || *p == '`') {
+            Capture *capture = arena_alloc(&line_arena, sizeof(Capture));
+            capture->next = NULL;
+            p = substitute(p, capture);
+            if (!p) {
+                captures_free(*captures);
+                return -1;
+            }
+            *tail = capture;
+            tail = &capture->next;
+            total += capture->len;
+        } else if (*p == '$') {
+            size_t len;
+            p = expand_dollar(p, NULL, &len);
+            if (!p) {
+                captures_free(*captures);
+                return -1;
+            }
+            total += len;
+        } else {
+            dquote ^= *p++ == '"';
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief 词法分析：把一行切分为单词和运算符
+ *
+ * 支持单引号、双引号和反斜杠转义；运算符两侧不需要空格。
+ * 紧跟在重定向运算符前的数字（如2>中的2）作为描述符编号记在运算符中。
+ * 未加引号和双引号中的$引用就地展开为变量的值，$(...)和`...`展开为命令的输出
+ * （去掉末尾的换行）；展开结果不再分词，也不作为通配符，只由未加引号的引用
+ * 组成的空单词被丢弃。
+ * 单词内容复制到内存池中的一块缓冲区，总长度不超过原行长度加上各引用的值的长度。
+ * 含未加引号的通配符的单词另外记下模式，由parse_command展开。
+ * @return 词法单元个数，引号不匹配或引用不合法时返回-1
+ */
+int tokenize(const char *line, Token **tokens_out) {
+    size_t line_len = strlen(line);
+    Capture *captures = NULL; // 命令替换的输出，按出现顺序取用
+    if (strchr(line, '$') || strchr(line, '`')) {
+        long extra = expansion_length(line, &captures);
+        if (extra < 0) return -1;
+        line_len += extra;
+    }
+    Capture *capture = captures;
+    char *text = arena_alloc(&line_arena, line_len + 1);
+    // 行中有通配符时另外生成模式文本，加引号或转义的字符前加\，最长为两倍
+    char *pat = strpbrk(line, "*?[") ? arena_alloc(&line_arena, line_len * 2 + 1) : NULL;
+    int cap = 16, count = 0;
+    Token *tokens = arena_alloc(&line_arena, cap * sizeof(Token));
+    const char *p = line;
+    
+    while (1) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0') break;
+        
+        if (count == cap) {
+            Token *grown = arena_alloc(&line_arena, cap * 2 * sizeof(Token));
+            memcpy(grown, tokens, cap * sizeof(Token));
+            tokens = grown;
+            cap *= 2;
+        }
+        Token *tok = &tokens[count++];
+        tok->text = NULL;
+        tok->pattern = NULL;
+        tok->fd = -1;
+        tok->assign = 0;
+        
+        // 描述符编号：单词开头的数字后直接跟<或>
+        const char *digits = p;
+        int io_number = 0;
+        while (*digits >= '0' && *digits <= '9' && digits - p < 8) {
+            io_number = io_number * 10 + (*digits++ - '0');
+        }
+        if (digits > p && (*digits == '<' || *digits == '>')) {
+            tok->fd = io_number;
+            p = digits;
+        }
+        
+        if (*p == '|') {
+            tok->type = TOK_PIPE;
+            p++;
+        } else if (*p == '&') {
+            tok->type = TOK_AMP;
+            p++;
+        } else if (*p == '<') {
+            tok->type = (p[1] == '&') ? TOK_LESSAND : TOK_LESS;
+            p += (p[1] == '&') ? 2 : 1;
+        } else if (*p == '>') {
+            if (p[1] == '>') {
+                tok->type = TOK_DGREAT;
+            } else {
+                tok->type = (p[1] == '&') ? TOK_GREATAND : TOK_GREAT;
+            }
+            p += (p[1] == '>' || p[1] == '&') ? 2 : 1;
+        } else {
+            tok->type = TOK_WORD;
+            tok->text = text;
+            char *pat_start = pat;
+            int wild = 0;
+            int only_refs = 1; // 单词只由未加引号的$引用组成
+            int plain = 1;     // 到目前为止没有引号、转义和引用，第一个=处据此判断赋值
+            while (*p && !strchr(" \t|&<>", *p)) {
+                char *quoted = text; // 从这里开始复制的字符按字面处理
+                int ref = *p == '$' || *p == '`';
+                size_t len;
+                if (ref && (*p == '`' || p[1] == '(')) {
+                    p = substitution_end(p);
+                    memcpy(text, capture->buf, capture->len);
+                    text += capture->len;
+                    capture = capture->next;
+                } else if (ref) {
+                    p = expand_dollar(p, text, &len);
+                    text += len;
+                } else if (*p == '\'') {
+                    // 单引号内全部按字面处理
+                    const char *close = strchr(p + 1, '\'');
+                    if (!close) {
+                        fprintf(stderr, "mybash: unexpected EOF while looking for matching `''\n");
+                        captures_free(captures);
+                        return -1;
+                    }
+                    memcpy(text, p + 1, close - p - 1);
+                    text += close - p - 1;
+                    p = close + 1;
+                } else if (*p == '"') {
+                    // 双引号内展开$引用和命令替换，只处理\"、\\、\$和\`转义
+                    p++;
+                    while (*p && *p != '"') {
+                        if ((*p == '$' && p[1] == '(') || *p == '`') {
+                            p = substitution_end(p);
+                            memcpy(text, capture->buf, capture->len);
+                            text += capture->len;
+                            capture = capture->next;
+                            continue;
+                        }
+                        if (*p == '$') {
+                            p = expand_dollar(p, text, &len);
+                            text += len;
+                            continue;
+                        }
+                        if (*p == '\\' && (p[1] == '"' || p[1] == '\\' || p[1] == '$' || p[1] == '`')) p++;
+                        *text++ = *p++;
+                    }
+                    if (*p != '"') {
+                        fprintf(stderr, "mybash: unexpected EOF while looking for matching `\"'\n");
+                        captures_free(captures);
+                        return -1;
+                    }
+                    p++;
+                } else if (*p == '\\' && p[1]) {
+                    *text++ = p[1];
+                    p += 2;
+                } else {
+                    if (pat) {
+                        wild |= *p == '*' || *p == '?' || *p == '[';
+                        *pat++ = *p;
+                    }
+                    if (*p == '=' && plain) {
+                        tok->assign = var_name_valid(tok->text, text - tok->text);
+                        plain = 0;
+                    }
+                    *text++ = *p++;
+                    only_refs = 0;
+                    continue;
+                }
+                only_refs &= ref;
+                plain = 0;
+                for (; pat && quoted < text; quoted++) {
+                    if (strchr("*?[]\\", *quoted)) *pat++ = '\\';
+                    *pat++ = *quoted;
+                }
+            }
+            if (only_refs && text == tok->text) {
+                count--; // 展开为空的引用不产生参数
+                pat = pat_start;
+                continue;
+            }
+            *text++ = '\0';
+            if (pat) {
+                *pat++ = '\0';
+                tok->pattern = wild ? pat_start : NULL;
+            }
+        }
+    }
+    
+    captures_free(captures);
+    *tokens_out = tokens;
+    return count;
+}
+
+/**
+ * @brief 解析命令字符串
+ *
+ * 所有数据（单词、argv数组、重定向记录）都分配在line_arena中，
+ * 阶段数和参数个数没有上限，通配符展开出的参数也是如此。
+ * @return 成功返回0，语法错误返回-1（已报告）
+ */
+int parse_command(const char *line, CommandLine *cmdline) {
+    Token *tokens;
+    int ntokens = tokenize(line, &tokens);
+    if (ntokens < 0) return -1;
+    
+    cmdline->stages = NULL;
+    cmdline->nstages = 0;
+    cmdline->background = 0;
+    cmdline->timed = 0;
+    cmdline->pipe_size = -1;
+    cmdline->affinity = -1;
+    cmdline->cpus = NULL;
+    cmdline->sched = -1;
+    cmdline->text = line;
+    
+    // 开头的关键字作用于整条管道：time、pipesize 容量、cpus 亲和性、sched 调度类
+    while (ntokens > 0 && tokens[0].type == TOK_WORD) {
+        const char *keyword = tokens[0].text;
+        if (strcmp(keyword, "time") == 0) {
+            cmdline->timed = 1;
+            tokens++;
+            ntokens--;
+            continue;
+        }
+        if (ntokens < 2 || tokens[1].type != TOK_WORD) break;
+        const char *arg = tokens[1].text;
+        if (strcmp(keyword, "pipesize") == 0) {
+            if (parse_pipe_size(arg, &cmdline->pipe_size) != 0) {
+                fprintf(stderr, "mybash: pipesize: invalid size: %s\n", arg);
+                return -1;
+            }
+        } else if (strcmp(keyword, "cpus") == 0) {
+            cmdline->cpus = arena_alloc(&line_arena, sizeof(cpu_set_t));
+            cmdline->affinity = parse_affinity(arg, cmdline->cpus);
+            if (cmdline->affinity < 0) {
+                fprintf(stderr, "mybash: cpus: invalid CPU list: %s\n", arg);
+                return -1;
+            }
+        } else if (strcmp(keyword, "sched") == 0) {
+            cmdline->sched = parse_sched_class(arg);
+            if (cmdline->sched < 0) {
+                fprintf(stderr, "mybash: sched: invalid class: %s\n", arg);
+                return -1;
+            }
+        } else {
+            break;
+        }
+        tokens += 2;
+        ntokens -= 2;
+    }
+    if (ntokens == 0) return 0;
+    
+    // 检查是否有后台运行标记 &（只能出现在行尾）
+    if (tokens[ntokens - 1].type == TOK_AMP) {
+        cmdline->background = 1;
+        ntokens--;
+    }
+    
+    // 统计阶段数
+    int nstages = 1;
+    for (int i = 0; i < ntokens; i++) {
+        if (tokens[i].type == TOK_AMP) {
+            syntax_error(&tokens[i]);
+            return -1;
+        }
+        if (tokens[i].type == TOK_PIPE) nstages++;
+    }
+    if (ntokens == 0) {
+        syntax_error(&tokens[0]);
+        return -1;
+    }
+    
+    Stage *stages = arena_alloc(&line_arena, nstages * sizeof(Stage));
+    int pos = 0;
+    for (int n = 0; n < nstages; n++) {
+        Stage *stage = &stages[n];
+        
+        // 先统计本阶段的参数个数，再一次性分配argv；命令名之前的赋值单独存放
+        int argc = 0, nassigns = 0, end = pos;
+        for (; end < ntokens && tokens[end].type != TOK_PIPE; end++) {
+            if (tokens[end].type == TOK_WORD) {
+                if (argc == 0 && tokens[end].assign) {
+                    nassigns++;
+                } else {
+                    argc++;
+                }
+            } else if (end + 1 >= ntokens || tokens[end + 1].type != TOK_WORD) {
+                // 重定向符号后必须跟文件名
+                syntax_error(end + 1 < ntokens ? &tokens[end + 1] : NULL);
+                return -1;
+            } else {
+                argc--; // 文件名不计入参数
+            }
+        }
+        // 只有赋值的命令只能单独出现
+        if (argc == 0 && (nassigns == 0 || nstages > 1)) {
+            syntax_error(end < ntokens ? &tokens[end] : NULL);
+            return -1;
+        }
+        
+        int argv_cap = argc + 1;
+        stage->argv = arena_alloc(&line_arena, argv_cap * sizeof(char *));
+        stage->argc = 0;
+        stage->redirects = NULL;
+        stage->assigns = nassigns ? arena_alloc(&line_arena, nassigns * sizeof(char *)) : NULL;
+        stage->nassigns = 0;
+        Redirect **tail = &stage->redirects;
+        
+        // 解析命令参数和重定向符号
+        for (int i = pos; i < end; i++) {
+            Token *tok = &tokens[i];
+            char **matches;
+            int nmatches;
+            if (tok->type == TOK_WORD) {
+                if (stage->argc == 0 && tok->assign) {
+                    stage->assigns[stage->nassigns++] = tok->text; // 值不做通配符展开
+                    continue;
+                }
+                nmatches = tok->pattern ? glob_expand(tok->pattern, &matches) : 0;
+                if (nmatches == 0) {
+                    stage->argv[stage->argc++] = tok->text;
+                    continue;
+                }
+                // 通配符展开后参数变多，argv按需加大
+                if (nmatches > 1) {
+                    argv_cap += nmatches - 1;
+                    char **grown = arena_alloc(&line_arena, argv_cap * sizeof(char *));
+                    memcpy(grown, stage->argv, stage->argc * sizeof(char *));
+                    stage->argv = grown;
+                }
+                memcpy(stage->argv + stage->argc, matches, nmatches * sizeof(char *));
+                stage->argc += nmatches;
+                continue;
+            }
+            Redirect *redir = arena_alloc(&line_arena, sizeof(Redirect));
+            const char *word = tokens[++i].text;
+            // 重定向的目标只能展开为一个文件
+            nmatches = tokens[i].pattern ? glob_expand(tokens[i].pattern, &matches) : 0;
+            if (nmatches > 1) {
+                fprintf(stderr, "mybash: %s: ambiguous redirect\n", word);
+                return -1;
+            }
+            if (nmatches == 1) {
+                word = matches[0];
+            }
+            int input = tok->type == TOK_LESS || tok->type == TOK_LESSAND;
+            redir->fd = tok->fd >= 0 ? tok->fd : (input ? STDIN_FILENO : STDOUT_FILENO);
+            redir->path = NULL;
+            redir->opened = -1;
+            redir->next = NULL;
+            if (tok->type == TOK_LESSAND || tok->type == TOK_GREATAND) {
+                // 目标只能是描述符编号或-
+                char *end;
+                long src = strtol(word, &end, 10);
+                if (strcmp(word, "-") == 0) {
+                    redir->type = REDIR_CLOSE;
+                } else if (*word >= '0' && *word <= '9' && *end == '\0' && src < INT_MAX) {
+                    redir->type = REDIR_DUP;
+                    redir->src = src;
+                } else {
+                    fprintf(stderr, "mybash: %s: ambiguous redirect\n", word);
+                    return -1;
+                }
+            } else {
+                redir->type = REDIR_FILE;
+                redir->path = word;
+                if (input) {
+                    redir->flags = O_RDONLY;
+                } else {
+                    redir->flags = O_WRONLY | O_CREAT |
+                                   (tok->type == TOK_DGREAT ? O_APPEND : O_TRUNC);
+                }
+            }
+            *tail = redir;
+            tail = &redir->next;
+        }
+        stage->argv[stage->argc] = NULL;
+        pos = end + 1;
+    }
+    
+    cmdline->stages = stages;
+    cmdline->nstages = nstages;
+    return 0;
+}
+
+/**********************************************************************
+ * 命令执行函数
+ **********************************************************************/
+
+/**
+ * @brief 在shell中打开阶段的重定向文件
+ *
+ * 文件带O_CLOEXEC打开，并移到所有重定向目标之上，
+ * 这样子进程中按顺序dup2时不会覆盖还没用到的描述符。
+ * 在创建子进程之前打开，路径错误时可以不启动任何进程。
+ * @return 成功返回0，失败返回-1（已报告错误，已打开的文件已关闭）
+ */
+int open_redirect_files(Stage *stage) {
+    int base = 10;
+    for (Redirect *redir = stage->redirects; redir; redir = redir->next) {
+        if (redir->fd >= base) base = redir->fd + 1;
+        if (redir->type == REDIR_DUP && redir->src >= base) base = redir->src + 1;
+    }
+    
+    for (Redirect *redir = stage->redirects; redir; redir = redir->next) {
+        if (redir->type != REDIR_FILE) continue;
+        int fd = open(redir->path, redir->flags | O_CLOEXEC, 0644);
+        if (fd >= 0 && fd < base) {
+            int moved = fcntl(fd, F_DUPFD_CLOEXEC, base);
+            close(fd);
+            fd = moved;
+        }
+        if (fd < 0) {
+            perror(redir->path);
+            close_redirect_files(stage);
+            return -1;
+        }
+        redir->opened = fd;
+    }
+    return 0;
+}
+
+/**
+ * @brief 关闭open_redirect_files打开的文件
+ */
+void close_redirect_files(Stage *stage) {
+    for (Redirect *redir = stage->redirects; redir; redir = redir->next) {
+        if (redir->opened >= 0) {
+            close(redir->opened);
+            redir->opened = -1;
+        }
+    }
+}
+
+/**
+ * @brief 把阶段的重定向记录按出现顺序转换为描述符操作（文件需已打开）
+ */
+void spec_add_redirects(LaunchSpec *spec, const Stage *stage) {
+    for (Redirect *redir = stage->redirects; redir; redir = redir->next) {
+        if (redir->type == REDIR_FILE) {
+            spec_add_dup2(spec, redir->opened, redir->fd);
+        } else if (redir->type == REDIR_DUP) {
+            spec_add_dup2(spec, redir->src, redir->fd);
+        } else {
+            spec_add_close(spec, redir->fd);
+        }
+    }
+}
+
+/**
+ * @brief 解析要启动的命令：subshell、filter和带-R的ls直接调用函数，其余查找可执行文件
+ * @return 找不到命令时报告错误并返回-1
+ */
+int resolve_command(LaunchSpec *spec, char **argv) {
+    spec->argv = argv;
+    Builtin *builtin = find_builtin(argv[0]);
+    if (builtin && (builtin->place == BUILTIN_SUBSHELL ||
+                    (builtin->place == BUILTIN_FILTER && filter_supported(argv)) ||
+                    (builtin->place == BUILTIN_WALK && mybin_ls_recursive(argv)))) {
+        spec->path = argv[0];
+        spec->func = builtin->func;
+        return 0;
+    }
+    unsigned long long t = stat_now();
+    spec->path = lookup_command(argv[0]);
+    stat_record(STAT_LOOKUP, t);
+    if (!spec->path) {
+        fprintf(stderr, "%s: command not found\n", argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 打印time的汇总结果（格式与bash相同）
+ */
+void print_times(double real, double user, double sys) {
+    fprintf(stderr, "\nreal\t%dm%.3fs\nuser\t%dm%.3fs\nsys\t%dm%.3fs\n",
+            (int)(real / 60), real - (int)(real / 60) * 60,
+            (int)(user / 60), user - (int)(user / 60) * 60,
+            (int)(sys / 60), sys - (int)(sys / 60) * 60);
+}
+
+/**
+ * @brief time关键字：报告前台作业的总耗时，管道还报告每个阶段
+ * @param names 与作业中各进程对应的命令名
+ */
+void report_job_times(const struct timespec *start, const Job *job, char **names) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double user = 0, sys = 0;
+    for (int i = 0; i < job->nprocs; i++) {
+        user += timeval_seconds(&job->procs[i].usage.ru_utime);
+        sys += timeval_seconds(&job->procs[i].usage.ru_stime);
+    }
+    print_times(elapsed_seconds(start, &now), user, sys);
+    if (job->nprocs < 2) {
+        return;
+    }
+    
+    // 每个阶段从启动到被回收的时间，暂停的进程算到现在
+    for (int i = 0; i < job->nprocs; i++) {
+        const Process *proc = &job->procs[i];
+        const struct timespec *end = proc->state == JOB_DONE ? &proc->end : &now;
+        fprintf(stderr, "%d: %s\treal %.3fs\tuser %.3fs\tsys %.3fs\tmaxrss %ldKB\n",
+                i + 1, names[i], elapsed_seconds(&proc->start, end),
+                timeval_seconds(&proc->usage.ru_utime),
+                timeval_seconds(&proc->usage.ru_stime), proc->usage.ru_maxrss);
+    }
+}
+
+/**
+ * @brief time关键字：报告在shell进程中完成的命令（内置命令、没能启动的命令）的耗时
+ */
+void report_builtin_times(const struct timespec *start, const struct rusage *before) {
+    struct timespec now;
+    struct rusage after;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &after);
+    print_times(elapsed_seconds(start, &now),
+                timeval_seconds(&after.ru_utime) - timeval_seconds(&before->ru_utime),
+                timeval_seconds(&after.ru_stime) - timeval_seconds(&before->ru_stime));
+}
+
+/**
+ * @brief 应用命令前的赋值：设为导出变量，原来的状态保存在返回的数组中
+ */
+ShellVar *assigns_apply(const Stage *stage) {
+    if (stage->nassigns == 0) {
+        return NULL;
+    }
+    ShellVar *saved = arena_alloc(&line_arena, stage->nassigns * sizeof(ShellVar));
+    for (int i = 0; i < stage->nassigns; i++) {
+        const char *word = stage->assigns[i];
+        size_t len = strchr(word, '=') - word;
+        ShellVar *var = var_slot(word, len, 1);
+        saved[i] = *var;
+        saved[i].entry = var->entry ? arena_strdup(&line_arena, var->entry) : NULL;
+        var_set(word, len, word + len + 1, 1);
+    }
+    return saved;
+}
+
+/**
+ * @brief 恢复assigns_apply之前的变量状态（倒序，同名变量赋值多次时恢复最早的）
+ */
+void assigns_restore(const Stage *stage, const ShellVar *saved) {
+    for (int i = stage->nassigns - 1; i >= 0; i--) {
+        size_t len = strlen(saved[i].name);
+        var_set(saved[i].name, len, saved[i].entry ? saved[i].entry + len + 1 : NULL,
+                saved[i].exported);
+    }
+}
+
+/**
+ * @brief 执行单条命令
+ * @return 命令启动了返回1；找不到命令、重定向或启动失败时返回0
+ */
+int execute_single_command(CommandLine *cmdline) {
+    Stage *stage = &cmdline->stages[0];
+    int background = cmdline->background;
+    const char *command_str = cmdline->text;
+    char **myargv = stage->argv;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    // 在父进程中解析路径，找不到的命令不必创建子进程
+    hash_check_path();
+    LaunchSpec spec = {0};
+    if (resolve_command(&spec, myargv) != 0) {
+        last_status = EXIT_NOT_FOUND;
+        return 0;
+    }
+    spec.foreground = !background;
+    // 没有作业控制时前台命令留在shell的进程组中，能收到终端的Ctrl+C
+    spec.pgid = (shell_is_interactive || background) ? 0 : -1;
+    spec_set_placement(&spec, cmdline);
+    
+    // 输入输出重定向处理
+    if (open_redirect_files(stage) != 0) {
+        last_status = 1;
+        return 0;
+    }
+    spec_add_redirects(&spec, stage);
+    
+    pid_t pid = launch_process(&spec);
+    close_redirect_files(stage);
+    if (pid == -1) {
+        last_status = launch_failure_status();
+        return 0;
+    }
+    
+    Process proc = {0};
+    proc.pid = pid;
+    proc.state = JOB_RUNNING;
+    proc.start = start;
+    if (background) {
+        // 后台作业：添加到作业列表
+        int job_id = add_job(pid, JOB_RUNNING, command_str, 0, &proc, 1);
+        if (job_id != -1 && shell_is_interactive) {
+            printf("[%d] %d\n", job_id, pid);
+        }
+        last_status = 0;
+    } else {
+        // 前台作业：等待完成
+        if (shell_is_interactive) {
+            unsigned long long t = stat_now();
+            tcsetpgrp(STDIN_FILENO, pid);
+            stat_record(STAT_TCSETPGRP, t);
+        }
+        
+        Job job = {0};
+        job.pgid = pid;
+        job.status = JOB_RUNNING;
+        job.procs = &proc;
+        job.nprocs = 1;
+        wait_for_job(&job);
+        
+        if (shell_is_interactive) {
+            tcsetpgrp(STDIN_FILENO, shell_pgid);
+        }
+        
+        last_status = job_exit_status(&job);
+        if (cmdline->timed) {
+            report_job_times(&cmdline->time_start, &job, myargv);
+        }
+        
+        // 缓存的路径可能已失效
+        if (proc.state == JOB_DONE && WIFEXITED(proc.status) &&
+            WEXITSTATUS(proc.status) == EXIT_NOT_FOUND) {
+            hash_validate(myargv[0]);
+        }
+        
+        // 检查作业是否被暂停
+        if (job.status == JOB_STOPPED) {
+            // 添加到作业列表
+            int job_id = add_job(pid, JOB_STOPPED, command_str, 0, &proc, 1);
+            if (job_id != -1) {
+                printf("\n[%d]+\tStopped\t\t%s\n", job_id, command_str);
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 执行管道命令
+ * @return 至少启动了一个阶段返回1，否则返回0
+ */
+int execute_pipeline(CommandLine *cmdline) {
+    int cmd_count = cmdline->nstages;
+    int background = cmdline->background;
+    const char *command_str = cmdline->text;
+    pid_t pgid = 0;
+    int started = 0;
+    int prev_pipe = -1;
+    int fd[2];
+    pid_t *pids = arena_alloc(&line_arena, cmd_count * sizeof(pid_t));
+    Process *procs = arena_alloc(&line_arena, cmd_count * sizeof(Process));
+    char **names = arena_alloc(&line_arena, cmd_count * sizeof(char *));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // 没有作业控制时前台管道留在shell的进程组中
+    int own_group = shell_is_interactive || background;
+    int pipe_size = cmdline->pipe_size >= 0 ? cmdline->pipe_size : pipe_size_mode;
+    // 只在shell等待的前台管道上自适应调整
+    PipeMonitor *monitor = NULL;
+    if (pipe_size == PIPE_SIZE_ADAPTIVE && !background) {
+        monitor = pipe_monitor_new(cmd_count - 1);
+    }
+    
+    hash_check_path();
+    
+    // 先打开所有阶段的重定向文件，任何一个失败都不启动管道
+    for (int i = 0; i < cmd_count; i++) {
+        if (open_redirect_files(&cmdline->stages[i]) != 0) {
+            for (int j = 0; j < i; j++) {
+                close_redirect_files(&cmdline->stages[j]);
+            }
+            last_status = 1;
+            return 0;
+        }
+    }
+    
+    for (int i = 0; i < cmd_count; i++) {
+        char **argv = cmdline->stages[i].argv;
+        
+        // 创建管道（最后一个命令不需要输出管道）
+        // 管道带O_CLOEXEC，dup2到标准输入输出后的副本不受影响，其余在exec时自动关闭
+        if (i < cmd_count - 1) {
+            if (pipe2(fd, O_CLOEXEC) == -1) {
+                perror("pipe");
+                if (prev_pipe != -1) close(prev_pipe);
+                cmd_count = i;
+                break;
+            }
+            pipe_apply_size(fd[1], pipe_size);
+            if (monitor) {
+                struct stat st;
+                fstat(fd[0], &st);
+                monitor->pipes[i].ino = st.st_ino;
+                monitor->pipes[i].size = fcntl(fd[1], F_GETPIPE_SZ);
+            }
+        }
+        
+        LaunchSpec spec = {0};
+        spec.pgid = own_group ? pgid : -1;
+        spec.foreground = !background && i == 0;
+        spec_set_placement(&spec, cmdline);
+        
+        // 从上一个命令读（如果不是第一个命令）
+        if (i > 0) {
+            spec_add_dup2(&spec, prev_pipe, STDIN_FILENO);
+        }
+        
+        // 输出到下一个命令（如果不是最后一个命令）
+        if (i < cmd_count - 1) {
+            spec_add_dup2(&spec, fd[1], STDOUT_FILENO);
+        }
+        
+        // 阶段自己的重定向在管道之后应用，可以覆盖管道（如2>&1 |）
+        spec_add_redirects(&spec, &cmdline->stages[i]);
+        
+        // 命令前的赋值只在启动这一阶段时生效
+        ShellVar *saved = assigns_apply(&cmdline->stages[i]);
+        if (saved) {
+            hash_check_path(); // 可能给PATH赋了值
+        }
+        pid_t pid = -1;
+        if (resolve_command(&spec, argv) == 0) {
+            pid = launch_process(&spec);
+            if (pid == -1) {
+                last_status = launch_failure_status();
+            }
+        } else {
+            last_status = EXIT_NOT_FOUND;
+        }
+        assigns_restore(&cmdline->stages[i], saved);
+        pids[i] = pid;
+        
+        // 第一个成功启动的进程作为进程组组长
+        if (pid > 0) {
+            memset(&procs[started], 0, sizeof(Process));
+            procs[started].pid = pid;
+            procs[started].state = JOB_RUNNING;
+            clock_gettime(CLOCK_MONOTONIC, &procs[started].start);
+            names[started] = argv[0];
+            started++;
+            if (pgid == 0) {
+                pgid = pid;
+            }
+        }
+        
+        // 关闭前一个管道的读端（如果有）
+        if (i > 0) {
+            close(prev_pipe);
+        }
+        
+        // 保存当前管道读端（用于下一个命令）
+        if (i < cmd_count - 1) {
+            close(fd[1]); // 关闭写端
+            prev_pipe = fd[0]; // 保存读端
+        }
+    }
+    
+    // 重定向文件已dup到子进程中
+    for (int i = 0; i < cmdline->nstages; i++) {
+        close_redirect_files(&cmdline->stages[i]);
+    }
+    
+    if (started == 0) {
+        return 0; // 没有任何进程启动成功
+    }
+    
+    if (background) {
+        // 后台管道作业：添加到作业列表
+        int job_id = add_job(pgid, JOB_RUNNING, command_str, 1, procs, started);
+        if (job_id != -1 && shell_is_interactive) {
+            printf("[%d] %d\n", job_id, pgid);
+        }
+        last_status = 0;
+    } else {
+        // 前台管道作业：等待所有进程完成或暂停
+        if (shell_is_interactive) {
+            unsigned long long t = stat_now();
+            tcsetpgrp(STDIN_FILENO, pgid);
+            stat_record(STAT_TCSETPGRP, t);
+        }
+        
+        Job job = {0};
+        job.pgid = pgid;
+        job.status = JOB_RUNNING;
+        job.is_pipeline = 1;
+        job.procs = procs;
+        job.nprocs = started;
+        if (monitor) {
+            monitor->npipes = cmd_count - 1;
+            for (int i = 0; i < monitor->npipes; i++) {
+                monitor->pipes[i].writer = pids[i];
+                monitor->pipes[i].reader = pids[i + 1];
+            }
+            pipe_monitor = monitor;
+        }
+        wait_for_job(&job);
+        pipe_monitor = NULL;
+        
+        if (shell_is_interactive) {
+            tcsetpgrp(STDIN_FILENO, shell_pgid);
+        }
+        
+        // 管道的退出状态取最后一个阶段（它启动失败时保留失败状态）
+        if (job.status == JOB_STOPPED || pids[cmd_count - 1] > 0) {
+            last_status = job_exit_status(&job);
+        }
+        if (cmdline->timed) {
+            report_job_times(&cmdline->time_start, &job, names);
+        }
+        for (int i = 0, k = 0; i < cmd_count; i++) {
+            if (pids[i] <= 0) continue;
+            Process *proc = &procs[k++];
+            if (proc->state == JOB_DONE && WIFEXITED(proc->status) &&
+                WEXITSTATUS(proc->status) == EXIT_NOT_FOUND) {
+                hash_validate(cmdline->stages[i].argv[0]);
+            }
+        }
+        
+        // 如果有进程被暂停，添加到作业列表
+        if (job.status == JOB_STOPPED) {
+            int job_id = add_job(pgid, JOB_STOPPED, command_str, 1, procs, started);
+            if (job_id != -1) {
+                printf("\n[%d]+\tStopped\t\t%s\n", job_id, command_str);
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief 执行解析好的一行命令
+ * @param start,before time的计时起点，NULL表示从现在开始
+ */
+void execute_command(CommandLine *cmdline, const struct timespec *start,
+                     const struct rusage *before) {
+    if (cmdline->nstages == 0) {
+        return;
+    }
+    
+    if (cmdline->timed && start) {
+        cmdline->time_start = *start;
+        cmdline->time_before = *before;
+    } else if (cmdline->timed) {
+        clock_gettime(CLOCK_MONOTONIC, &cmdline->time_start);
+        getrusage(RUSAGE_SELF, &cmdline->time_before);
+    }
+    
+    if (cmdline->nstages == 1 && cmdline->stages[0].argc == 0) {
+        // 只有赋值：设置shell变量，重定向的文件照常创建
+        Stage *stage = &cmdline->stages[0];
+        last_status = open_redirect_files(stage) != 0;
+        close_redirect_files(stage);
+        for (int i = 0; i < stage->nassigns; i++) {
+            var_assign(stage->assigns[i], -1);
+        }
+        if (cmdline->timed) {
+            report_builtin_times(&cmdline->time_start, &cmdline->time_before);
+        }
+    } else if (cmdline->nstages == 1) {
+        // 内置命令直接在shell中处理
+        Stage *stage = &cmdline->stages[0];
+        ShellVar *saved = assigns_apply(stage);
+        if (handle_builtin_commands(stage, cmdline->background)) {
+            if (cmdline->timed) {
+                report_builtin_times(&cmdline->time_start, &cmdline->time_before);
+            }
+        } else if (!execute_single_command(cmdline) && cmdline->timed) {
+            report_builtin_times(&cmdline->time_start, &cmdline->time_before); // 同bash，命令没能启动也照样报告
+        }
+        assigns_restore(stage, saved);
+    } else if (!execute_pipeline(cmdline) && cmdline->timed) {
+        report_builtin_times(&cmdline->time_start, &cmdline->time_before);
+    }
+}
+
+/**
+ * @brief 解析并执行一行命令
+ */
+void execute_line(const char *line) {
+    stat_begin_line(line);
+    unsigned long long line_start = stat_now();
+    // 命令替换在解析时执行，time要从解析之前开始计时；行中没有"time"时不必取时间
+    int maybe_timed = strstr(line, "time") != NULL;
+    struct timespec start;
+    struct rusage before;
+    if (maybe_timed) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        getrusage(RUSAGE_SELF, &before);
+    }
+    CommandLine cmdline;
+    int err = parse_command(line, &cmdline);
+    stat_record(STAT_PARSE, line_start);
+    if (err != 0) {
+        last_status = EXIT_USAGE;
+        return;
+    }
+    execute_command(&cmdline, maybe_timed ? &start : NULL, &before);
+    stat_record(STAT_LINE, line_start);
+}
+
+/**********************************************************************
+ * 命令替换
+ *
+ * $(...)和`...`在解析时执行，输出（去掉末尾的换行）代替原文。
+ * 只向stdout输出、不改变shell状态的内置命令（pwd、jobs、history）直接在
+ * shell中执行，stdout临时换成open_memstream的内存缓冲区，不创建进程也不用
+ * 管道；单条外部命令和在子进程中运行的内置命令照常启动，标准输出接到一个
+ * 管道上，shell读到文件结束为止，缓冲区按需加倍；管道和其他内置命令在
+ * fork出的子shell中执行，输出同样经一个管道读回。替换中的命令分配在
+ * 同一个line_arena中，整行执行完后才重置。
+ **********************************************************************/
+
+/**
+ * @brief 读取fd直到文件结束，缓冲区从CAPTURE_INITIAL_SIZE开始按需加倍
+ */
+void capture_read(int fd, Capture *out) {
+    size_t cap = CAPTURE_INITIAL_SIZE;
+    out->buf = malloc(cap);
+    out->len = 0;
+    while (out->buf) {
+        if (out->len == cap) {
+            cap *= 2;
+            char *grown = realloc(out->buf, cap);
+            if (!grown) {
+                perror("realloc");
+                exit(1);
+            }
+            out->buf = grown;
+        }
+        ssize_t n = read(fd, out->buf + out->len, cap - out->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        out->len += n;
+    }
+    if (!out->buf) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+/**
+ * @brief 等待命令替换启动的子进程结束，退出状态记录在last_status中
+ */
+void capture_wait(pid_t pid) {
+    Process proc = {0};
+    proc.pid = pid;
+    proc.state = JOB_RUNNING;
+    Job job = {0};
+    job.pgid = pid;
+    job.status = JOB_RUNNING;
+    job.procs = &proc;
+    job.nprocs = 1;
+    wait_for_job(&job);
+    last_status = job_exit_status(&job);
+}
+
+/**
+ * @brief 在shell中执行内置命令，stdout换成内存缓冲区
+ */
+void capture_builtin(const Builtin *builtin, Stage *stage, Capture *out) {
+    size_t size = 0;
+    fflush(stdout);
+    FILE *saved_stdout = stdout;
+    stdout = open_memstream(&out->buf, &size);
+    if (!stdout) {
+        stdout = saved_stdout;
+        perror("open_memstream");
+        last_status = 1;
+        return;
+    }
+    ShellVar *saved = assigns_apply(stage);
+    unsigned long long t = stat_now();
+    last_status = builtin->func(stage->argc, stage->argv);
+    stat_record(STAT_BUILTIN, t);
+    assigns_restore(stage, saved);
+    fclose(stdout);
+    stdout = saved_stdout;
+    out->len = size;
+}
+
+/**
+ * @brief 启动单条命令，标准输出接到管道上，读完后等待它结束
+ */
+void capture_external(CommandLine *cmdline, Capture *out) {
+    Stage *stage = &cmdline->stages[0];
+    int fd[2];
+    if (pipe2(fd, O_CLOEXEC) == -1) {
+        perror("pipe");
+        last_status = 1;
+        return;
+    }
+    ShellVar *saved = assigns_apply(stage);
+    hash_check_path();
+    LaunchSpec spec = {0};
+    pid_t pid = -1;
+    if (resolve_command(&spec, stage->argv) != 0) {
+        last_status = EXIT_NOT_FOUND;
+    } else if (open_redirect_files(stage) != 0) {
+        last_status = 1;
+    } else {
+        spec.pgid = -1; // 留在shell的进程组中，终端的Ctrl+C同样送到
+        spec_set_placement(&spec, cmdline);
+        spec_add_dup2(&spec, fd[1], STDOUT_FILENO);
+        spec_add_redirects(&spec, stage);
+        pid = launch_process(&spec);
+        close_redirect_files(stage);
+        if (pid == -1) {
+            last_status = launch_failure_status();
+        }
+    }
+    assigns_restore(stage, saved);
+    close(fd[1]);
+    capture_read(fd[0], out);
+    close(fd[0]);
+    if (pid > 0) {
+        capture_wait(pid);
+    }
+}
+
+/**
+ * @brief 在fork出的子shell中执行整条命令，标准输出经管道读回
+ */
+void capture_subshell(CommandLine *cmdline, Capture *out) {
+    int fd[2];
+    if (pipe2(fd, O_CLOEXEC) == -1) {
+        perror("pipe");
+        last_status = 1;
+        return;
+    }
+    fflush(stdout);
+    reader_sync(shared_input);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (dup2(fd[1], STDOUT_FILENO) == -1) {
+            perror("dup2");
+            _exit(1);
+        }
+        // 子shell不使用终端；epoll实例与shell共享，必须重新创建；
+        // fork服务进程创建的子进程不是子shell的子进程，改用spawn
+        close(epoll_fd);
+        close(sigchld_fd);
+        input_fd = -1;
+        input_pollable = 0;
+        init_events();
+        shell_is_interactive = 0;
+        if (launch_mode == LAUNCH_SERVER) {
+            launch_mode = LAUNCH_SPAWN;
+        }
+        execute_command(cmdline, NULL, NULL);
+        fflush(stdout);
+        _exit(last_status);
+    }
+    close(fd[1]);
+    if (pid == -1) {
+        perror("fork");
+        last_status = 1;
+    }
+    capture_read(fd[0], out);
+    close(fd[0]);
+    if (pid > 0) {
+        capture_wait(pid);
+    }
+}
+
+/**
+ * @brief 执行命令替换中的命令，收集标准输出并去掉末尾的换行
+ *
+ * 退出状态记录在last_status中。
+ */
+void capture_command(const char *line, Capture *out) {
+    out->buf = NULL;
+    out->len = 0;
+    CommandLine cmdline;
+    if (parse_command(line, &cmdline) != 0) {
+        last_status = EXIT_USAGE;
+        return;
+    }
+    if (cmdline.nstages == 0) {
+        return;
+    }
+    Stage *stage = &cmdline.stages[0];
+    Builtin *builtin = stage->argc ? find_builtin(stage->argv[0]) : NULL;
+    int simple = cmdline.nstages == 1 && stage->argc && !cmdline.background && !cmdline.timed;
+    if (simple && builtin && builtin->capture && !stage->redirects) {
+        capture_builtin(builtin, stage, out);
+    } else if (simple && (!builtin || (builtin->place != BUILTIN_SHELL &&
+                                       builtin->place != BUILTIN_WALK))) {
+        capture_external(&cmdline, out);
+    } else {
+        capture_subshell(&cmdline, out);
+    }
+    while (out->len > 0 && out->buf[out->len - 1] == '\n') {
+        out->len--;
+    }
+}
+
+/**********************************************************************
+ * 输入读取
+ **********************************************************************/
+
+/**
+ * @brief 初始化从描述符读取的行读取器
+ */
+void reader_init_fd(LineReader *reader, int fd) {
+    reader->fd = fd;
+    reader->mode = READER_PRIVATE;
+    reader->cap = READ_BLOCK_SIZE;
+    reader->buf = malloc(reader->cap);
+    if (!reader->buf) {
+        perror("malloc");
+        exit(1);
+    }
+    reader->start = reader->end = 0;
+    reader->eof = 0;
+}
+
+/**
+ * @brief 初始化读取内存中字符串的行读取器（-c模式），就地切分
+ */
+void reader_init_string(LineReader *reader, char *str) {
+    reader->fd = -1;
+    reader->mode = READER_PRIVATE;
+    reader->buf = str;
+    reader->cap = strlen(str) + 1;
+    reader->start = 0;
+    reader->end = reader->cap - 1;
+    reader->eof = 1;
+}
+
+/**
+ * @brief 标记读取器的描述符与命令共享（脚本来自标准输入）
+ *
+ * 同sh：可定位的输入仍按块读取，启动命令前由reader_sync退回多读的部分；
+ * 管道只能逐字节读取，保证命令看到的正好是脚本之后的剩余输入。
+ */
+void reader_share(LineReader *reader) {
+    reader->mode = lseek(reader->fd, 0, SEEK_CUR) == -1 ? READER_BYTEWISE : READER_SEEKABLE;
+    shared_input = reader;
+}
+
+/**
+ * @brief 把共享描述符的读取位置退回到已返回的行末，丢弃多读的数据
+ *
+ * 在命令可能读取标准输入之前调用；没有多读的数据时不做系统调用。
+ */
+void reader_sync(LineReader *reader) {
+    if (reader && reader->mode == READER_SEEKABLE && reader->end > reader->start) {
+        lseek(reader->fd, -(off_t)(reader->end - reader->start), SEEK_CUR);
+        reader->end = reader->start;
+    }
+}
+
+/**
+ * @brief 读取下一行
+ *
+ * 每次read一大块数据（READER_BYTEWISE时一个字节），在缓冲区中就地把换行符
+ * 替换为'\0'，行超过缓冲区时按倍增扩容。
+ * @return 指向缓冲区内的行，下次调用前有效；输入结束返回NULL
+ */
+char *reader_next_line(LineReader *reader) {
+    while (1) {
+        char *start = reader->buf + reader->start;
+        char *newline = memchr(start, '\n', reader->end - reader->start);
+        if (newline) {
+            *newline = '\0';
+            reader->start = newline + 1 - reader->buf;
+            return start;
+        }
+        
+        if (reader->eof) {
+            if (reader->start == reader->end) {
+                return NULL;
+            }
+            // 最后一行没有换行符（end < cap，总能放下结束符）
+            reader->buf[reader->end] = '\0';
+            reader->start = reader->end;
+            return start;
+        }
+        
+        // 把未完成的行移到缓冲区开头，缓冲区满时扩容（保留一个字节放结束符）
+        size_t pending = reader->end - reader->start;
+        if (reader->start > 0) {
+            memmove(reader->buf, start, pending);
+            reader->start = 0;
+            reader->end = pending;
+        }
+        if (reader->end + 1 >= reader->cap) {
+            char *grown = realloc(reader->buf, reader->cap * 2);
+            if (!grown) {
+                perror("realloc");
+                exit(1);
+            }
+            reader->buf = grown;
+            reader->cap *= 2;
+        }
+        
+        // 逐字节读取时只在行首等待（期间回收子进程），行中间直接阻塞在read上
+        size_t want = reader->cap - reader->end - 1;
+        if (reader->mode == READER_BYTEWISE) {
+            want = 1;
+        }
+        if (pending == 0 || reader->mode != READER_BYTEWISE) {
+            wait_for_input(reader->fd);
+        }
+        ssize_t n = read(reader->fd, reader->buf + reader->end, want);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            reader->eof = 1;
+        } else {
+            reader->end += n;
+        }
+    }
+}
+
+/**********************************************************************
+ * 行编辑器
+ *
+ * 交互模式下终端处于原始模式，由shell自己处理按键：光标移动、删除、
+ * 上下键浏览历史、Ctrl+R增量反向搜索和Tab补全。每行开始时从启动时保存的
+ * 终端设置切换到原始模式，读完一行后恢复，命令总在正常模式下运行。
+ * 等待按键时仍通过wait_for_input回收子进程。
+ *
+ * 命令名补全使用内置命令和PATH_BIN、$PATH中可执行文件构成的前缀树，
+ * 第一次补全时建立，并对各目录加inotify监视；之后每次补全只检查inotify
+ * 有无事件，目录变化或PATH改变时才重建。文件名补全用getdents64读取目录，
+ * d_type已经区分出目录，不需要逐项stat。
+ **********************************************************************/
+
+enum {
+    KEY_UP = 1000, KEY_DOWN, KEY_LEFT, KEY_RIGHT, KEY_HOME, KEY_END, KEY_DELETE
+};
+
+#define CTRL_KEY(c) ((c) & 0x1f)
+
+/**
+ * @brief 读取启动时的终端设置，判断能否使用行编辑器
+ */
+void editor_init() {
+    const char *term = var_get("TERM");
+    editor_enabled = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) &&
+                     !(term && strcmp(term, "dumb") == 0) &&
+                     tcgetattr(STDIN_FILENO, &shell_tmodes) == 0;
+}
+
+/**
+ * @brief 切换到原始模式：逐字节读取、不回显，Ctrl+C/Ctrl+Z等作为普通按键
+ */
+void editor_raw_mode() {
+    struct termios raw = shell_tmodes;
+    raw.c_iflag &= ~(ICRNL | IXON);
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+}
+
+/**
+ * @brief 恢复启动时的终端设置（同时纠正上一条命令留下的终端模式）
+ */
+void editor_cooked_mode() {
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+}
+
+/**
+ * @brief 读取一个字节，粘贴的多余输入留在缓冲区中给之后的按键和行
+ * @return 字节值，输入结束返回-1
+ */
+int editor_getc() {
+    while (editor.in_start == editor.in_end) {
+        wait_for_input(STDIN_FILENO);
+        ssize_t n = read(STDIN_FILENO, editor.in, sizeof(editor.in));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        editor.in_start = 0;
+        editor.in_end = n;
+    }
+    return (unsigned char)editor.in[editor.in_start++];
+}
 
-    char *cmd = strtok(temp_buff, " ");
-    if (!cmd) {
-        free(temp_buff);
+/**
+ * @brief 读取一个按键，把方向键等转义序列转换为KEY_*
+ */
+int editor_key() {
+    int c = editor_getc();
+    if (c != '\033') {
+        return c;
+    }
+    int c1 = editor_getc();
+    if (c1 != '[' && c1 != 'O') {
+        return c1 < 0 ? -1 : 0; // 单独的ESC和Alt组合键忽略
+    }
+    int c2 = editor_getc();
+    if (c2 >= '0' && c2 <= '9') {
+        // ESC [ 数字 ~
+        int c3;
+        while ((c3 = editor_getc()) >= '0' && c3 <= '9') {
+        }
+        if (c3 != '~') return 0;
+        switch (c2) {
+        case '1': case '7': return KEY_HOME;
+        case '4': case '8': return KEY_END;
+        case '3': return KEY_DELETE;
+        }
         return 0;
     }
+    switch (c2) {
+    case 'A': return KEY_UP;
+    case 'B': return KEY_DOWN;
+    case 'C': return KEY_RIGHT;
+    case 'D': return KEY_LEFT;
+    case 'H': return KEY_HOME;
+    case 'F': return KEY_END;
+    }
+    return c2 < 0 ? -1 : 0;
+}
+
+/**
+ * @brief 文本在终端上的宽度：跳过ESC[...m颜色序列，UTF-8按字符计
+ */
+int display_width(const char *s, size_t len) {
+    int width = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\033' && i + 1 < len && s[i + 1] == '[') {
+            while (i < len && !(s[i] >= '@' && s[i] <= '~' && s[i] != '[')) i++;
+            continue;
+        }
+        if (((unsigned char)s[i] & 0xc0) != 0x80) width++;
+    }
+    return width;
+}
+
+/**
+ * @brief 终端列数
+ */
+int terminal_columns() {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+        return ws.ws_col;
+    }
+    return 80;
+}
+
+/**
+ * @brief 保证编辑缓冲区能再放下extra个字节和结束符
+ */
+void editor_reserve(size_t extra) {
+    if (editor.len + extra + 1 <= editor.cap) {
+        return;
+    }
+    size_t cap = editor.cap ? editor.cap : 256;
+    while (editor.len + extra + 1 > cap) cap *= 2;
+    char *buf = realloc(editor.buf, cap);
+    if (!buf) {
+        perror("realloc");
+        exit(1);
+    }
+    editor.buf = buf;
+    editor.cap = cap;
+}
+
+/**
+ * @brief 在光标处插入文本
+ */
+void editor_insert(const char *text, size_t n) {
+    editor_reserve(n);
+    memmove(editor.buf + editor.pos + n, editor.buf + editor.pos, editor.len - editor.pos);
+    memcpy(editor.buf + editor.pos, text, n);
+    editor.len += n;
+    editor.pos += n;
+}
+
+/**
+ * @brief 删除[from, to)之间的文本，光标移到from
+ */
+void editor_delete(size_t from, size_t to) {
+    memmove(editor.buf + from, editor.buf + to, editor.len - to);
+    editor.len -= to - from;
+    editor.pos = from;
+}
+
+/**
+ * @brief 把编辑缓冲区替换为text
+ */
+void editor_set(const char *text, size_t n) {
+    editor.len = editor.pos = 0;
+    editor_insert(text, n);
+}
+
+/**
+ * @brief 光标左右移动一个字符（跳过UTF-8后续字节）
+ */
+size_t editor_prev_char(size_t pos) {
+    while (pos > 0 && ((unsigned char)editor.buf[--pos] & 0xc0) == 0x80) {
+    }
+    return pos;
+}
+
+size_t editor_next_char(size_t pos) {
+    while (pos < editor.len && ((unsigned char)editor.buf[++pos] & 0xc0) == 0x80) {
+    }
+    return pos;
+}
+
+/**
+ * @brief 重画当前行：提示符、编辑缓冲区，并把光标放回原位
+ *
+ * 一行放不下时水平滚动，保证光标可见。整行用一次write输出。
+ */
+void editor_refresh() {
+    int cols = terminal_columns();
+    int prompt_width = display_width(prompt_buf, prompt_len);
+    size_t start = 0;
+    while (prompt_width + display_width(editor.buf + start, editor.pos - start) >= cols &&
+           start < editor.pos) {
+        start = editor_next_char(start);
+    }
+    size_t end = editor.len;
+    while (prompt_width + display_width(editor.buf + start, end - start) >= cols && end > editor.pos) {
+        end = editor_prev_char(end);
+    }
     
-    // 解析命令参数
-    char *arg = strtok(NULL, " ");
+    char *out = arena_alloc(&line_arena, prompt_len + (end - start) + 32);
+    int n = 0;
+    out[n++] = '\r';
+    memcpy(out + n, prompt_buf, prompt_len);
+    n += prompt_len;
+    memcpy(out + n, editor.buf + start, end - start);
+    n += end - start;
+    int col = prompt_width + display_width(editor.buf + start, editor.pos - start);
+    n += sprintf(out + n, "\033[K\r");
+    if (col > 0) {
+        n += sprintf(out + n, "\033[%dC", col);
+    }
+    if (write(STDOUT_FILENO, out, n) < 0) {
+        return;
+    }
+}
+
+/**
+ * @brief 用getdents64遍历目录，对每一项调用fn（d_type来自内核，不需要stat）
+ */
+void scan_dir(int dirfd, void (*fn)(int dirfd, const char *name, unsigned char type, void *arg),
+              void *arg) {
+    char *dents = arena_alloc(&line_arena, DENTS_BUF_SIZE);
+    ssize_t n;
+    while ((n = getdents64(dirfd, dents, DENTS_BUF_SIZE)) > 0) {
+        for (ssize_t off = 0; off < n;) {
+            struct dirent64 *d = (struct dirent64 *)(dents + off);
+            off += d->d_reclen;
+            fn(dirfd, d->d_name, d->d_type, arg);
+        }
+    }
+}
+
+/**
+ * @brief 在前缀树中找到或插入字符c对应的子节点（兄弟节点按字符递增）
+ * @return 节点下标，不插入且不存在时返回0
+ */
+int trie_child(int node, unsigned char c, int insert) {
+    TrieNode *nodes = command_trie.nodes;
+    int prev = 0; // 插入位置之前的兄弟节点，0表示插在最前面
+    int next = nodes[node].child;
+    while (next && nodes[next].c < c) {
+        prev = next;
+        next = nodes[next].sibling;
+    }
+    if (next && nodes[next].c == c) {
+        return next;
+    }
+    if (!insert) {
+        return 0;
+    }
+    if (command_trie.count == command_trie.cap) {
+        int cap = command_trie.cap * 2;
+        nodes = realloc(nodes, cap * sizeof(TrieNode));
+        if (!nodes) {
+            perror("realloc");
+            exit(1);
+        }
+        command_trie.nodes = nodes;
+        command_trie.cap = cap;
+    }
+    int idx = command_trie.count++;
+    nodes[idx] = (TrieNode){c, 0, next, 0};
+    if (prev) {
+        nodes[prev].sibling = idx;
+    } else {
+        nodes[node].child = idx;
+    }
+    return idx;
+}
+
+/**
+ * @brief 把命令名加入前缀树
+ */
+void trie_insert(const char *name) {
+    int node = 0;
+    for (const char *p = name; *p; p++) {
+        node = trie_child(node, *p, 1);
+    }
+    command_trie.nodes[node].terminal = 1;
+}
+
+/**
+ * @brief scan_dir回调：可执行的普通文件（或指向它的符号链接）加入前缀树
+ */
+void trie_add_entry(int dirfd, const char *name, unsigned char type, void *arg) {
+    (void)arg;
+    if (name[0] == '.' || type == DT_DIR) {
+        return;
+    }
+    if (type != DT_REG) {
+        struct stat st;
+        if (fstatat(dirfd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+            return;
+        }
+    }
+    if (faccessat(dirfd, name, X_OK, 0) == 0) {
+        trie_insert(name);
+    }
+}
+
+/**
+ * @brief 读取一个目录中的可执行文件并监视该目录
+ */
+void trie_add_dir(const char *dir, size_t len) {
+    char path[PATH_MAX];
+    if (len == 0) {
+        strcpy(path, "."); // 空的PATH项表示当前目录
+    } else {
+        snprintf(path, sizeof(path), "%.*s", (int)len, dir);
+    }
+    int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) {
+        return;
+    }
+    scan_dir(dirfd, trie_add_entry, NULL);
+    close(dirfd);
+    inotify_add_watch(command_trie.inotify_fd, path,
+                      IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                      IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+}
+
+/**
+ * @brief 重新建立命令名前缀树和inotify监视
+ */
+void trie_build(const char *path_env) {
+    if (command_trie.inotify_fd >= 0) {
+        close(command_trie.inotify_fd); // 同时撤销所有监视
+    }
+    command_trie.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (!command_trie.nodes) {
+        command_trie.cap = 1024;
+        command_trie.nodes = malloc(command_trie.cap * sizeof(TrieNode));
+        if (!command_trie.nodes) {
+            perror("malloc");
+            exit(1);
+        }
+    }
+    command_trie.count = 1;
+    command_trie.nodes[0] = (TrieNode){0, 0, 0, 0};
     
-    int is_builtin = 0; // 标记是否为内置命令
+    for (int i = 0; i < NUM_BUILTINS; i++) {
+        trie_insert(builtins[i].name);
+    }
+    trie_add_dir(PATH_BIN, strlen(PATH_BIN));
+    const char *dirs = path_env;
+    while (1) {
+        const char *end = strchr(dirs, ':');
+        size_t len = end ? (size_t)(end - dirs) : strlen(dirs);
+        if (len > 0 || end) {
+            trie_add_dir(dirs, len);
+        }
+        if (!end) break;
+        dirs = end + 1;
+    }
+    command_trie.path_version = vars.path_version;
+}
+
+/**
+ * @brief 补全前调用：PATH改变或被监视的目录有变化时重建前缀树
+ */
+void trie_refresh() {
+    const char *path = var_get("PATH");
+    if (!path) path = "";
+    int stale = !command_trie.nodes || command_trie.path_version != vars.path_version;
+    if (!stale && command_trie.inotify_fd >= 0) {
+        char events[4096];
+        while (read(command_trie.inotify_fd, events, sizeof(events)) > 0) {
+            stale = 1; // 读空事件队列，一次重建处理所有变化
+        }
+    }
+    if (stale) {
+        trie_build(path);
+    }
+}
+
+/**
+ * @brief 加入一个候选项（分配在line_arena中）
+ */
+void completions_add(Completions *comp, const char *name, size_t len, int is_dir) {
+    if (comp->count == comp->cap) {
+        int cap = comp->cap ? comp->cap * 2 : 64;
+        char **items = arena_alloc(&line_arena, cap * sizeof(char *));
+        if (comp->count) memcpy(items, comp->items, comp->count * sizeof(char *));
+        comp->items = items;
+        comp->cap = cap;
+    }
+    char *item = arena_alloc(&line_arena, len + 2);
+    memcpy(item, name, len);
+    if (is_dir) item[len++] = '/';
+    item[len] = '\0';
+    comp->items[comp->count++] = item;
+}
+
+/**
+ * @brief 收集前缀树中node以下的全部命令名（按字典序）
+ */
+void trie_collect(int node, char *name, size_t depth, Completions *comp) {
+    if (command_trie.nodes[node].terminal) {
+        completions_add(comp, name, depth, 0);
+    }
+    for (int child = command_trie.nodes[node].child; child; child = command_trie.nodes[child].sibling) {
+        if (depth + 1 >= PATH_MAX) continue;
+        name[depth] = command_trie.nodes[child].c;
+        trie_collect(child, name, depth + 1, comp);
+    }
+}
+
+/**
+ * @brief 命令名补全
+ */
+void complete_command(const char *prefix, Completions *comp) {
+    trie_refresh();
+    int node = 0;
+    for (const char *p = prefix; *p; p++) {
+        node = trie_child(node, *p, 0);
+        if (node == 0) return;
+    }
+    char name[PATH_MAX];
+    size_t depth = strlen(prefix);
+    memcpy(name, prefix, depth);
+    trie_collect(node, name, depth, comp);
+}
+
+typedef struct {
+    const char *prefix;
+    size_t len;
+    Completions *comp;
+} FileMatch;
+
+/**
+ * @brief scan_dir回调：名字以前缀开头的目录项（隐藏文件只在前缀以.开头时列出）
+ */
+void file_match_entry(int dirfd, const char *name, unsigned char type, void *arg) {
+    FileMatch *match = arg;
+    if (strncmp(name, match->prefix, match->len) != 0 ||
+        (name[0] == '.' && match->prefix[0] != '.') ||
+        strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return;
+    }
+    int is_dir = type == DT_DIR;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+        // 文件系统不提供类型，或者是符号链接（指向目录时按目录补全）
+        struct stat st;
+        is_dir = fstatat(dirfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+    }
+    completions_add(match->comp, name, strlen(name), is_dir);
+}
+
+/**
+ * @brief 文件名补全：word中最后一个'/'之前是目录，之后是名字前缀
+ * @return 名字前缀在word中的起始位置
+ */
+size_t complete_file(const char *word, Completions *comp) {
+    const char *slash = strrchr(word, '/');
+    char dir[PATH_MAX];
+    size_t base = 0;
+    if (slash) {
+        base = slash - word + 1;
+        snprintf(dir, sizeof(dir), "%.*s", (int)base, word);
+    } else {
+        strcpy(dir, ".");
+    }
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) {
+        return base;
+    }
+    FileMatch match = {word + base, strlen(word + base), comp};
+    scan_dir(dirfd, file_match_entry, &match);
+    close(dirfd);
+    return base;
+}
+
+int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief 在光标处插入补全的文本，特殊字符用反斜杠转义
+ */
+void editor_insert_escaped(const char *text, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (strchr(" \t'\"\\|&<>", text[i])) {
+            editor_insert("\\", 1);
+        }
+        editor_insert(text + i, 1);
+    }
+}
+
+/**
+ * @brief 分多列列出候选项，然后在下一行重画提示符
+ */
+void editor_list(Completions *comp) {
+    size_t width = 0;
+    for (int i = 0; i < comp->count; i++) {
+        size_t len = strlen(comp->items[i]);
+        if (len > width) width = len;
+    }
+    width += 2;
+    int per_row = terminal_columns() / width;
+    if (per_row < 1) per_row = 1;
+    int rows = (comp->count + per_row - 1) / per_row;
+    printf("\n");
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < per_row; c++) {
+            int i = c * rows + r;
+            if (i >= comp->count) break;
+            printf("%-*s", (int)width, comp->items[i]);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
 
-    if (strcmp(cmd, "cd") == 0) {
-        cmd_cd(arg);
-        is_builtin = 1;
+/**
+ * @brief Tab补全：行首、|或&之后的单词补全命令名，其余补全文件名
+ *
+ * 唯一的候选项直接补全（目录后加'/'，其余加空格）；多个候选项时补全到
+ * 公共前缀，无法再延长时列出全部候选项。
+ */
+void editor_complete() {
+    // 光标前的单词，跳过反斜杠转义
+    size_t start = editor.pos;
+    while (start > 0) {
+        char c = editor.buf[start - 1];
+        int escaped = start >= 2 && editor.buf[start - 2] == '\\';
+        if (!escaped && strchr(" \t|&<>", c)) break;
+        start--;
+    }
+    char *word = arena_alloc(&line_arena, editor.pos - start + 1);
+    size_t wlen = 0;
+    for (size_t i = start; i < editor.pos; i++) {
+        if (editor.buf[i] == '\\' && i + 1 < editor.pos) i++;
+        else if (editor.buf[i] == '\'' || editor.buf[i] == '"') continue;
+        word[wlen++] = editor.buf[i];
+    }
+    word[wlen] = '\0';
+    
+    size_t before = start;
+    while (before > 0 && (editor.buf[before - 1] == ' ' || editor.buf[before - 1] == '\t')) before--;
+    int command = (before == 0 || editor.buf[before - 1] == '|' || editor.buf[before - 1] == '&') &&
+                  !strchr(word, '/');
+    
+    Completions comp = {0};
+    size_t base = 0;
+    if (command) {
+        complete_command(word, &comp);
+    } else {
+        base = complete_file(word, &comp);
+        qsort(comp.items, comp.count, sizeof(char *), compare_strings);
+    }
+    if (comp.count == 0) {
+        return;
+    }
+    
+    // 公共前缀中超出已输入部分的内容
+    size_t typed_len = wlen - base;
+    size_t common = strlen(comp.items[0]);
+    for (int i = 1; i < comp.count; i++) {
+        size_t j = 0;
+        while (j < common && comp.items[i][j] == comp.items[0][j]) j++;
+        common = j;
+    }
+    if (common > typed_len) {
+        editor_insert_escaped(comp.items[0] + typed_len, common - typed_len);
     }
-    else if (strcmp(cmd, "exit") == 0) {
-        free(temp_buff);
-        free(original_cmd);
-        exit(0);
+    if (comp.count == 1) {
+        size_t len = strlen(comp.items[0]);
+        if (len == 0 || comp.items[0][len - 1] != '/') {
+            editor_insert(" ", 1);
+        }
+    } else if (common <= typed_len) {
+        editor_list(&comp);
     }
-    else if (strcmp(cmd, "jobs") == 0) {
-        cmd_jobs();
-        is_builtin = 1;
+}
+
+/**
+ * @brief Ctrl+R增量反向搜索
+ *
+ * 输入字符继续缩小范围，再按Ctrl+R找更早的匹配，退格放宽条件；回车执行
+ * 匹配的记录，Ctrl+G恢复原来的行，其他键接受匹配的记录后继续编辑。
+ * @return 回车时返回1，否则返回0
+ */
+int editor_search() {
+    char query[256];
+    size_t qlen = 0;
+    int match = -1;
+    char *saved = arena_alloc(&line_arena, editor.len + 1);
+    memcpy(saved, editor.buf, editor.len);
+    size_t saved_len = editor.len;
+    
+    while (1) {
+        size_t len = 0;
+        const char *text = match >= 0 ? history_entry(match, &len) : "";
+        char *out = arena_alloc(&line_arena, qlen + len + 64);
+        int n = sprintf(out, "\r(%sreverse-i-search)`%.*s': ",
+                        qlen > 0 && match < 0 ? "failing " : "", (int)qlen, query);
+        memcpy(out + n, text, len);
+        n += len;
+        n += sprintf(out + n, "\033[K");
+        if (write(STDOUT_FILENO, out, n) < 0) {
+            return 0;
+        }
+        
+        int c = editor_key();
+        if (c == CTRL_KEY('r')) {
+            query[qlen] = '\0';
+            int next = qlen > 0 ? history_search(query, match) : -1;
+            if (next >= 0) match = next;
+            continue;
+        }
+        if (c == 127 || c == CTRL_KEY('h')) {
+            if (qlen > 0) qlen--;
+        } else if (c >= ' ' && c < 127 && qlen + 1 < sizeof(query)) {
+            query[qlen++] = c;
+        } else {
+            if (c == CTRL_KEY('g') || c == -1) {
+                editor_set(saved, saved_len);
+            } else if (match >= 0) {
+                text = history_entry(match, &len);
+                editor_set(text, len);
+            }
+            return c == '\r' || c == '\n';
+        }
+        // 查询改变后从最新的记录重新搜索
+        query[qlen] = '\0';
+        match = qlen > 0 ? history_search(query, -1) : -1;
     }
-    else if (strcmp(cmd, "fg") == 0) {
-        int job_id = -1;
-        if (arg) {
-            // 支持%前缀
-            if (arg[0] == '%') job_id = atoi(arg + 1);
-            else job_id = atoi(arg);
+}
+
+/**
+ * @brief 读取一行命令（交互模式）
+ * @return 指向编辑缓冲区的行，下次调用前有效；Ctrl+D或输入结束返回NULL
+ */
+char *editor_read_line() {
+    editor_raw_mode();
+    editor.len = editor.pos = 0;
+    editor_reserve(0);
+    int hist_pos = -1;         // 正在浏览的历史记录，-1表示正在编辑新行
+    char *draft = NULL;        // 开始浏览历史前正在编辑的行
+    size_t draft_len = 0;
+    fflush(stdout);
+    editor_refresh();
+    
+    while (1) {
+        int c = editor_key();
+        size_t len;
+        const char *text;
+        switch (c) {
+        case -1:
+            editor_cooked_mode();
+            return NULL;
+        case '\r':
+        case '\n':
+            editor.pos = editor.len;
+            editor_refresh();
+            if (write(STDOUT_FILENO, "\n", 1) < 0) {
+                // 终端不可写，下次读取时得到EOF
+            }
+            editor_cooked_mode();
+            editor.buf[editor.len] = '\0';
+            return editor.buf;
+        case CTRL_KEY('d'):
+            if (editor.len == 0) {
+                editor_cooked_mode();
+                return NULL;
+            }
+            // fall through
+        case KEY_DELETE:
+            if (editor.pos < editor.len) editor_delete(editor.pos, editor_next_char(editor.pos));
+            break;
+        case 127:
+        case CTRL_KEY('h'):
+            if (editor.pos > 0) editor_delete(editor_prev_char(editor.pos), editor.pos);
+            break;
+        case CTRL_KEY('c'):
+            // 放弃当前行
+            editor.pos = editor.len;
+            editor_refresh();
+            if (write(STDOUT_FILENO, "^C\n", 3) < 0) {
+            }
+            editor.len = editor.pos = 0;
+            hist_pos = -1;
+            last_status = 130;
+            break;
+        case CTRL_KEY('a'):
+        case KEY_HOME:
+            editor.pos = 0;
+            break;
+        case CTRL_KEY('e'):
+        case KEY_END:
+            editor.pos = editor.len;
+            break;
+        case CTRL_KEY('b'):
+        case KEY_LEFT:
+            editor.pos = editor_prev_char(editor.pos);
+            break;
+        case CTRL_KEY('f'):
+        case KEY_RIGHT:
+            editor.pos = editor_next_char(editor.pos);
+            break;
+        case CTRL_KEY('k'):
+            editor.len = editor.pos;
+            break;
+        case CTRL_KEY('u'):
+            editor_delete(0, editor.pos);
+            break;
+        case CTRL_KEY('w'): {
+            size_t start = editor.pos;
+            while (start > 0 && editor.buf[start - 1] == ' ') start--;
+            while (start > 0 && editor.buf[start - 1] != ' ') start--;
+            editor_delete(start, editor.pos);
+            break;
+        }
+        case CTRL_KEY('l'):
+            if (write(STDOUT_FILENO, "\033[H\033[2J", 7) < 0) {
+            }
+            break;
+        case '\t':
+            editor_complete();
+            break;
+        case CTRL_KEY('r'):
+            if (history_sync() == 0 && editor_search()) {
+                editor.pos = editor.len;
+                editor_refresh();
+                if (write(STDOUT_FILENO, "\n", 1) < 0) {
+                }
+                editor_cooked_mode();
+                editor.buf[editor.len] = '\0';
+                return editor.buf;
+            }
+            break;
+        case CTRL_KEY('p'):
+        case KEY_UP:
+            if (history_sync() != 0) break;
+            if (hist_pos < 0) {
+                if (history.count == 0) break;
+                draft = arena_alloc(&line_arena, editor.len + 1);
+                memcpy(draft, editor.buf, editor.len);
+                draft_len = editor.len;
+                hist_pos = history.count;
+            }
+            if (hist_pos > 0) {
+                text = history_entry(--hist_pos, &len);
+                editor_set(text, len);
+            }
+            break;
+        case CTRL_KEY('n'):
+        case KEY_DOWN:
+            if (hist_pos < 0) break;
+            if (++hist_pos >= history.count) {
+                hist_pos = -1;
+                editor_set(draft, draft_len);
+            } else {
+                text = history_entry(hist_pos, &len);
+                editor_set(text, len);
+            }
+            break;
+        default:
+            if (c >= ' ' && c < 256 && c != 127) {
+                char ch = c;
+                editor_insert(&ch, 1);
+            }
+            break;
         }
-        cmd_fg(job_id);
-        is_builtin = 1;
-    }
-    else if (strcmp(cmd, "bg") == 0) {
-        int job_id = -1;
-        if (arg) {
-            // 支持%前缀
-            if (arg[0] == '%') job_id = atoi(arg + 1);
-            else job_id = atoi(arg);
+        // 粘贴的内容全部处理完再重画
+        if (editor.in_start == editor.in_end) {
+            editor_refresh();
         }
-        cmd_bg(job_id);
-        is_builtin = 1;
     }
+}
 
-    free(temp_buff); // 释放副本
+/**********************************************************************
+ * 主循环
+ **********************************************************************/
 
-    if (is_builtin) {
-        free(original_cmd); // 如果是内置命令，释放原始命令字符串
-        return 1;
+/**
+ * @brief 逐行读取并执行命令，直到输入结束
+ * @param status_fd 不为-1时，每执行完一行非空命令写入"line 行号 退出状态\n"（--serve会话）
+ */
+void run_shell(LineReader *reader, int status_fd) {
+    unsigned long lineno = 0;
+    while (1) {
+        // 回收后台作业，报告上一条命令执行期间的状态变化
+        if (job_count > 0) {
+            reap_children();
+            flush_notifications();
+        }
+        if (shell_is_interactive && !editor_enabled) {
+            print_prompt();
+        }
+        
+        // 读取用户输入（行编辑器自己输出提示符）
+        char *line = editor_enabled ? editor_read_line() : reader_next_line(reader);
+        if (!line) {
+            // Ctrl+D 输入EOF，退出shell
+            if (shell_is_interactive) {
+                printf("exit\n");
+            }
+            break;
+        }
+        lineno++;
+        
+        // 交互模式下展开!引用并记入历史（空行不记）
+        if (shell_is_interactive && line[strspn(line, " \t")] != '\0') {
+            line = history_expand(line);
+            if (!line) {
+                last_status = 1;
+                continue;
+            }
+            history_add(line);
+        }
+        
+        execute_line(line);
+        
+        // 本行的单词、argv和重定向记录一次性释放
+        arena_reset(&line_arena);
+        
+        if (status_fd >= 0 && line[strspn(line, " \t")] != '\0') {
+            char reply[64];
+            int len = snprintf(reply, sizeof(reply), "line %lu %d\n", lineno, last_status);
+            send_full(status_fd, reply, len); // 客户端已断开时由守护进程结束会话
+        }
     }
-    
-    return 0; // 不是内置命令
 }
 
-
 /**********************************************************************
- * 命令提示符与解析
+ * 守护进程模式（--serve）
+ *
+ * 常驻的mybash02监听AF_UNIX套接字，每个连接fork出一个会话进程执行
+ * 客户端的脚本（协议见serve.h）。会话继承守护进程已初始化的作业表、
+ * 命令路径缓存和选项，省去每次启动shell的开销；会话中新缓存的命令名
+ * 通过管道报告给守护进程，由守护进程自己查找后加入缓存，之后的会话直接命中。
+ * 守护进程的主循环用epoll同时等待新连接、会话结束（signalfd）、
+ * 客户端断开和退出信号；客户端断开时向会话的进程组发送SIGHUP。
  **********************************************************************/
 
 /**
- * @brief 打印命令提示符
+ * @brief 会话进程：接收客户端的描述符、环境变量和脚本
+ * @return 成功返回0，协议错误返回-1
  */
-void print_prompt() {
-    char *user_str = "$";
-    int user_id = getuid();
+int serve_session_recv(int sock, LineReader *reader) {
+    ServeHeader header;
+    int fds[SERVER_MAX_FDS];
+    int nfds = 0;
+    if (recv_with_fds(sock, &header, sizeof(header), fds, &nfds) != 0) {
+        return -1;
+    }
     
-    // 检查是否是root用户
-    if (user_id == 0) {
-        user_str = "#";
+    int expected = 1 + __builtin_popcount(header.flags & (SERVE_STDIN | SERVE_STDOUT | SERVE_STDERR)) +
+                   ((header.flags & SERVE_SCRIPT_FD) != 0);
+    if (header.magic != SERVE_MAGIC || nfds != expected ||
+        (uint64_t)header.env_len + header.text_len > SERVE_MAX_PAYLOAD) {
+        fprintf(stderr, "mybash: serve: bad request\n");
+        for (int i = 0; i < nfds; i++) close(fds[i]);
+        return -1;
     }
     
-    // 获取用户信息
-    struct passwd *ptr = getpwuid(user_id);
-    if (!ptr) {
-        printf("mybash1.0>> ");
-        fflush(stdout);
-        return;
+    char *payload = malloc(header.env_len + header.text_len + 1);
+    if (!payload || recv_full(sock, payload, header.env_len + header.text_len) != 0) {
+        return -1;
     }
+    payload[header.env_len + header.text_len] = '\0';
     
-    // 获取主机名
-    char hostname[128] = {0};
-    if (gethostname(hostname, sizeof(hostname) - 1) == -1) {
-        printf("mybash1.0>> ");
-        fflush(stdout);
-        return;
+    // 环境变量：每项以'\0'结尾
+    int nenv = 0;
+    for (uint32_t i = 0; i < header.env_len; i++) {
+        if (payload[i] == '\0') nenv++;
+    }
+    char **envp = malloc((nenv + 1) * sizeof(char *));
+    if (!envp) {
+        return -1;
     }
+    char *p = payload;
+    for (int i = 0; i < nenv; i++, p += strlen(p) + 1) envp[i] = p;
+    envp[nenv] = NULL;
+    environ = envp;
+    var_clear();
+    var_import(envp);
     
-    // 获取当前工作目录
-    char dir[256] = {0};
-    if (getcwd(dir, sizeof(dir) - 1) == NULL) {
-        printf("mybash1.0>> ");
-        fflush(stdout);
-        return;
+    if (fchdir(fds[0]) == -1) {
+        perror("mybash: serve: fchdir");
+        return -1;
+    }
+    close(fds[0]);
+    int next = 1;
+    for (int i = 0; i < 3; i++) {
+        if (!(header.flags & (SERVE_STDIN << i))) {
+            close(i);
+            continue;
+        }
+        if (dup2(fds[next], i) == -1) {
+            perror("mybash: serve: dup2");
+            return -1;
+        }
+        close(fds[next++]);
     }
     
-    // 彩色打印提示符
-    printf("\033[1;32m%s@%s\033[0m:\033[1;34m%s\033[0m%s ",
-           ptr->pw_name, hostname, dir, user_str);
-    fflush(stdout);
+    if (header.flags & SERVE_SCRIPT_FD) {
+        reader_init_fd(reader, fds[next]);
+    } else {
+        reader_init_string(reader, payload + header.env_len);
+    }
+    return 0;
 }
 
 /**
- * @brief 解析命令字符串
+ * @brief 会话进程：执行一个客户端的脚本后退出
  */
-int parse_command(char *buff, char *commands[][MAX_ARGS_PER_COMMAND],
-                  int *in_redirect, int *out_redirect, int *append,
-                  char **in_file, char **out_file, int *background) {
-    *background = 0;
-    
-    // 检查是否有后台运行标记 &
-    size_t len = strlen(buff);
-    if (len > 0 && buff[len - 1] == '&') {
-        *background = 1;
-        buff[len - 1] = '\0'; // 移除 &
-        
-        // 移除&前的空格
-        while (len > 1 && buff[len - 2] == ' ') {
-            buff[len - 2] = '\0';
-            len--;
-        }
-    }
-    
-    char *saveptr;
-    char *token = strtok_r(buff, " ", &saveptr);
-    int cmd_idx = 0, arg_idx = 0;
-    
-    *in_redirect = 0;
-    *out_redirect = 0;
-    *append = 0;
-    *in_file = NULL;
-    *out_file = NULL;
-    
-    // 解析命令和重定向符号
-    while (token != NULL) {
-        if (strcmp(token, "<") == 0) {
-            *in_redirect = 1;
-            token = strtok_r(NULL, " ", &saveptr);
-            if (token) *in_file = token;
-            token = strtok_r(NULL, " ", &saveptr);
-            continue;
-        }
-        else if (strcmp(token, ">") == 0) {
-            *out_redirect = 1;
-            token = strtok_r(NULL, " ", &saveptr);
-            if (token) *out_file = token;
-            token = strtok_r(NULL, " ", &saveptr);
-            continue;
-        }
-        else if (strcmp(token, ">>") == 0) {
-            *out_redirect = 1;
-            *append = 1;
-            token = strtok_r(NULL, " ", &saveptr);
-            if (token) *out_file = token;
-            token = strtok_r(NULL, " ", &saveptr);
-            continue;
-        }
-        else if (strcmp(token, "|") == 0) {
-            commands[cmd_idx++][arg_idx] = NULL;
-            arg_idx = 0;
-            token = strtok_r(NULL, " ", &saveptr);
-            continue;
-        }
-        else {
-            commands[cmd_idx][arg_idx++] = token;
-        }
-        token = strtok_r(NULL, " ", &saveptr);
+void serve_session(int sock, int learn_fd) {
+    // 会话有自己的进程组，客户端断开时连同前台命令一起收到SIGHUP
+    setpgid(0, 0);
+    shell_pgid = getpid();
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    
+    // epoll实例在fork后仍与守护进程共享，必须重新创建
+    close(epoll_fd);
+    close(sigchld_fd);
+    input_fd = -1;
+    input_pollable = 0;
+    init_events();
+    if (server_fd >= 0) {
+        close(server_fd);
+        server_fd = -1;
+    }
+    
+    LineReader reader;
+    if (serve_session_recv(sock, &reader) != 0) {
+        exit(EXIT_USAGE);
     }
+    hash_learn_fd = learn_fd;
+    run_shell(&reader, sock);
     
-    commands[cmd_idx][arg_idx] = NULL;
-    return cmd_idx + 1; // 返回命令数量
+    // 自己回复退出状态，客户端不必等守护进程回收；关闭连接后守护进程的回复会被丢弃
+    fflush(NULL);
+    char reply[32];
+    int len = snprintf(reply, sizeof(reply), "exit %d\n", last_status);
+    send_full(sock, reply, len);
+    shutdown(sock, SHUT_WR);
+    exit(last_status);
 }
 
-/**********************************************************************
- * 命令执行函数
- **********************************************************************/
+/**
+ * @brief 守护进程：把会话报告的命令名加入缓存
+ *
+ * 每行不超过PIPE_BUF，读到半行时留到下次。
+ */
+void serve_learn(int fd) {
+    static char buf[2 * PIPE_BUF];
+    static size_t len = 0;
+    ssize_t n;
+    while ((n = read(fd, buf + len, sizeof(buf) - len)) > 0) {
+        len += n;
+        char *start = buf;
+        char *newline;
+        hash_check_path();
+        while ((newline = memchr(start, '\n', buf + len - start))) {
+            *newline = '\0';
+            hash_insert(start);
+            start = newline + 1;
+        }
+        len = buf + len - start;
+        memmove(buf, start, len);
+    }
+}
 
 /**
- * @brief 执行单条命令
+ * @brief 守护进程：回收结束的会话
+ *
+ * 正常结束的会话已自己回复了退出状态；执行exit或被信号终止的会话由这里回复。
  */
-void execute_single_command(char **myargv, int in_redirect, char *in_file,
-                           int out_redirect, char *out_file, int append,
-                           int background, const char *command_str) {
-    if (!myargv || !myargv[0]) return;
-    
-    pid_t pid = fork();
-    if (pid == -1) {
-        perror("fork");
-        return;
+void serve_reap() {
+    struct signalfd_siginfo info[16];
+    while (read(sigchld_fd, info, sizeof(info)) > 0) {
     }
     
-    if (pid == 0) { // 子进程
-        // 创建新进程组
-        if (setpgid(0, 0) == -1) {
-            perror("setpgid");
-            exit(1);
-        }
-        
-        // 如果不是后台作业且shell是交互式的，设置为前台进程组
-        if (!background && shell_is_interactive) {
-            tcsetpgrp(STDIN_FILENO, getpgrp());
-        }
-        
-        // 恢复默认信号处理
-        signal(SIGINT, SIG_DFL);
-        signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        signal(SIGTTIN, SIG_DFL);
-        signal(SIGTTOU, SIG_DFL);
-        
-        // 输入重定向处理
-        if (in_redirect && in_file) {
-            int fd = open(in_file, O_RDONLY);
-            if (fd < 0) {
-                perror("open input file");
-                exit(1);
-            }
-            if (dup2(fd, STDIN_FILENO) == -1) {
-                perror("dup2 input");
-                exit(1);
-            }
-            close(fd);
-        }
-        
-        // 输出重定向处理
-        if (out_redirect && out_file) {
-            int flags = O_WRONLY | O_CREAT;
-            flags |= (append) ? O_APPEND : O_TRUNC;
-            int fd = open(out_file, flags, 0644);
-            if (fd < 0) {
-                perror("open output file");
-                exit(1);
-            }
-            if (dup2(fd, STDOUT_FILENO) == -1) {
-                perror("dup2 output");
-                exit(1);
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int fd = 0; fd < serve_sessions_cap; fd++) {
+            if (serve_sessions[fd] != pid) {
+                continue;
             }
+            char reply[32];
+            int len = snprintf(reply, sizeof(reply), "exit %d\n", exit_status(status));
+            send_full(fd, reply, len);
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
             close(fd);
+            serve_sessions[fd] = 0;
+            break;
         }
-        
-        // 尝试在自定义目录中执行
-        char pathname[256];
-        snprintf(pathname, sizeof(pathname), "%s%s", PATH_BIN, myargv[0]);
-        if (access(pathname, X_OK) == 0) {
-            execv(pathname, myargv);
-        } else {
-            execvp(myargv[0], myargv);
+    }
+}
+
+/**
+ * @brief 守护进程：接受一个连接并fork出会话进程
+ */
+void serve_accept(int listen_fd, int signal_fd, int learn[2]) {
+    int sock = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+            perror("mybash: serve: accept");
         }
-        
-        perror("execvp error");
-        exit(1);
+        return;
+    }
+    // 套接字权限之外再检查对端身份，拒绝其他用户（如套接字所在目录被放宽时）
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 ||
+        cred.uid != geteuid()) {
+        fprintf(stderr, "mybash: serve: rejected connection from another user\n");
+        send_full(sock, "exit 126\n", 9);
+        close(sock);
+        return;
     }
-    else { // 父进程
-        // 设置进程组
-        if (setpgid(pid, pid) == -1 && errno != EACCES) {
-            perror("setpgid");
+    if (sock >= serve_sessions_cap) {
+        int cap = serve_sessions_cap ? serve_sessions_cap : JOB_INDEX_BUCKETS;
+        while (cap <= sock) cap *= 2;
+        pid_t *sessions = realloc(serve_sessions, cap * sizeof(pid_t));
+        if (!sessions) {
+            perror("realloc");
+            close(sock);
+            return;
         }
-        
-        if (background) {
-            // 后台作业：添加到作业列表
-            int job_id = add_job(pid, JOB_RUNNING, command_str, 0);
-            if (job_id != -1) {
-                printf("[%d] %d\n", job_id, pid);
-            }
-        } else {
-            // 前台作业：等待完成
-            if (shell_is_interactive) {
-                tcsetpgrp(STDIN_FILENO, pid);
-            }
-            
-            int status;
-            pid_t result = waitpid(pid, &status, WUNTRACED);
-            
-            if (shell_is_interactive) {
-                tcsetpgrp(STDIN_FILENO, shell_pgid);
-            }
-            
-            // 检查作业是否被暂停
-            if (result > 0 && WIFSTOPPED(status)) {
-                // 添加到作业列表
-                int job_id = add_job(pid, JOB_STOPPED, command_str, 0);
-                if (job_id != -1) {
-                    printf("\n[%d]+\tStopped\t\t%s\n", job_id, command_str);
-                }
+        memset(sessions + serve_sessions_cap, 0, (cap - serve_sessions_cap) * sizeof(pid_t));
+        serve_sessions = sessions;
+        serve_sessions_cap = cap;
+    }
+    
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(listen_fd);
+        close(signal_fd);
+        close(learn[0]);
+        for (int fd = 0; fd < serve_sessions_cap; fd++) {
+            if (serve_sessions[fd]) {
+                close(fd);
             }
         }
+        serve_session(sock, learn[1]);
+    }
+    if (pid < 0) {
+        perror("mybash: serve: fork");
+        send_full(sock, "exit 126\n", 9);
+        close(sock);
+        return;
     }
+    setpgid(pid, pid);
+    serve_sessions[sock] = pid;
+    
+    // 客户端只在连接开始时发送请求，之后对端关闭即表示客户端已退出
+    struct epoll_event ev = {0};
+    ev.events = EPOLLRDHUP;
+    ev.data.fd = sock;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &ev);
 }
 
 /**
- * @brief 执行管道命令
+ * @brief 在path上监听并服务客户端，收到SIGTERM、SIGINT或SIGHUP时退出
+ *
+ * 已在运行的会话不受守护进程退出影响，执行完后直接关闭连接。
  */
-void execute_pipeline(char *commands[][MAX_ARGS_PER_COMMAND], int cmd_count,
-                     int background, const char *command_str) {
-    pid_t pgid = 0;
-    int prev_pipe = -1;
-    int fd[2];
-    pid_t pids[MAX_COMMANDS];
+int serve_main(const char *path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "mybash: serve: %s: path too long\n", path);
+        return EXIT_USAGE;
+    }
+    strcpy(addr.sun_path, path);
     
-    for (int i = 0; i < cmd_count; i++) {
-        // 创建管道（最后一个命令不需要输出管道）
-        if (i < cmd_count - 1) {
-            if (pipe(fd) == -1) {
-                perror("pipe");
-                return;
-            }
-        }
-        
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
-            return;
-        }
-        
-        if (pid == 0) { // 子进程
-            // 设置进程组
-            if (i == 0) {
-                if (setpgid(0, 0) == -1) {
-                    perror("setpgid");
-                    exit(1);
-                }
-            } else {
-                if (setpgid(0, pids[0]) == -1) {
-                    perror("setpgid");
-                    exit(1);
-                }
-            }
-            
-            // 如果不是后台作业且shell是交互式的，设置为前台进程组
-            if (!background && shell_is_interactive && i == 0) {
-                tcsetpgrp(STDIN_FILENO, getpgrp());
-            }
-            
-            // 恢复默认信号处理
-            signal(SIGINT, SIG_DFL);
-            signal(SIGQUIT, SIG_DFL);
-            signal(SIGTSTP, SIG_DFL);
-            signal(SIGTTIN, SIG_DFL);
-            signal(SIGTTOU, SIG_DFL);
-            
-            // 从上一个命令读（如果不是第一个命令）
-            if (i > 0) {
-                if (dup2(prev_pipe, STDIN_FILENO) == -1) {
-                    perror("dup2 input");
-                    exit(1);
-                }
-                close(prev_pipe);
-            }
-            
-            // 输出到下一个命令（如果不是最后一个命令）
-            if (i < cmd_count - 1) {
-                close(fd[0]); // 关闭读端
-                if (dup2(fd[1], STDOUT_FILENO) == -1) {
-                    perror("dup2 output");
-                    exit(1);
-                }
-                close(fd[1]);
-            }
-            
-            // 执行当前命令
-            char *args[MAX_ARGS_PER_COMMAND];
-            int arg_idx = 0;
-            while (commands[i][arg_idx] != NULL) {
-                args[arg_idx] = commands[i][arg_idx];
-                arg_idx++;
-            }
-            args[arg_idx] = NULL;
-            
-            // 尝试在自定义目录中执行
-            char pathname[256];
-            snprintf(pathname, sizeof(pathname), "%s%s", PATH_BIN, args[0]);
-            if (access(pathname, X_OK) == 0) {
-                execv(pathname, args);
-            } else {
-                execvp(args[0], args);
-            }
-            
-            perror("execvp error");
-            exit(1);
-        }
-        else { // 父进程
-            pids[i] = pid;
-            
-            // 设置进程组
-            if (i == 0) {
-                if (setpgid(pid, pid) == -1 && errno != EACCES) {
-                    perror("setpgid");
-                }
-                pgid = pid;
-            } else {
-                if (setpgid(pid, pgid) == -1 && errno != EACCES) {
-                    perror("setpgid");
-                }
-            }
-            
-            // 关闭前一个管道的读端（如果有）
-            if (i > 0) {
-                close(prev_pipe);
-            }
-            
-            // 保存当前管道读端（用于下一个命令）
-            if (i < cmd_count - 1) {
-                close(fd[1]); // 关闭写端
-                prev_pipe = fd[0]; // 保存读端
-            }
-        }
+    init_jobs(0);
+    init_events();
+    
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    int signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int learn[2];
+    if (signal_fd == -1 || listen_fd == -1 || pipe2(learn, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("mybash: serve");
+        return 1;
     }
     
-    if (background) {
-        // 后台管道作业：添加到作业列表
-        int job_id = add_job(pgid, JOB_RUNNING, command_str, 1);
-        if (job_id != -1) {
-            printf("[%d] %d\n", job_id, pgid);
-        }
-    } else {
-        // 前台管道作业：等待所有进程完成
-        if (shell_is_interactive) {
-            tcsetpgrp(STDIN_FILENO, pgid);
+    // 只删除没有守护进程在监听的旧套接字
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        if (connect(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            fprintf(stderr, "mybash: serve: %s: already in use\n", path);
+            return 1;
         }
-        
-        int status;
-        pid_t result;
-        int stopped_count = 0;
-        
-        // 等待管道中的所有进程
-        for (int i = 0; i < cmd_count; i++) {
-            result = waitpid(pids[i], &status, WUNTRACED);
-            if (result > 0 && WIFSTOPPED(status)) {
-                stopped_count++;
+        unlink(path);
+    }
+    // 会话以守护进程的用户身份执行客户端脚本：套接字只允许本用户连接
+    mode_t old_mask = umask(077);
+    int bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound == -1 || listen(listen_fd, SOMAXCONN) == -1) {
+        fprintf(stderr, "mybash: serve: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    
+    int watched[] = {listen_fd, signal_fd, learn[0]};
+    for (int i = 0; i < 3; i++) {
+        struct epoll_event ev = {0};
+        ev.events = EPOLLIN;
+        ev.data.fd = watched[i];
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watched[i], &ev);
+    }
+    
+    int running = 1;
+    while (running) {
+        struct epoll_event events[64];
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            perror("epoll_wait");
+            break;
         }
-        
-        if (shell_is_interactive) {
-            tcsetpgrp(STDIN_FILENO, shell_pgid);
-        }
-        
-        // 如果有进程被暂停，添加到作业列表
-        if (stopped_count > 0) {
-            int job_id = add_job(pgid, JOB_STOPPED, command_str, 1);
-            if (job_id != -1) {
-                printf("\n[%d]+\tStopped\t\t%s\n", job_id, command_str);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == sigchld_fd) {
+                serve_reap();
+            } else if (fd == signal_fd) {
+                running = 0;
+            } else if (fd == listen_fd) {
+                serve_accept(listen_fd, signal_fd, learn);
+            } else if (fd == learn[0]) {
+                serve_learn(learn[0]);
+            } else if (fd < serve_sessions_cap && serve_sessions[fd] > 0) {
+                // 同一批事件中连接可能已随会话回收关闭并被新连接复用，确认对端已关闭
+                char c;
+                if (recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 0) {
+                    continue;
+                }
+                // 客户端已断开：结束会话，连接在回收会话时关闭
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                kill(-serve_sessions[fd], SIGHUP);
             }
         }
     }
+    unlink(path);
+    return 0;
 }
 
 /**********************************************************************
  * 主函数
  **********************************************************************/
 
-int main() {
-    // 初始化作业列表和shell环境
-    init_jobs();
-    
-    // 设置SIGCHLD信号处理函数
-    struct sigaction sa;
-    sa.sa_handler = handle_sigchld;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
-        perror("sigaction");
-        exit(1);
+/**
+ * @brief 用法：mybash02 [-c command | script | --serve socket]
+ *
+ * 带-c或脚本文件运行时为非交互模式：不打印提示符，不接管终端，
+ * 以最后一条命令的退出状态退出。标准输入不是终端时同样按非交互方式读取。
+ * --serve在套接字上作为守护进程运行，由mybashc提交脚本。
+ */
+int main(int argc, char *argv[]) {
+    LineReader reader;
+    
+    if (argc == 3 && strcmp(argv[1], "--fork-server") == 0) {
+        return fork_server_main(atoi(argv[2]));
+    }
+    if (argc == 3 && strcmp(argv[1], "--serve") == 0) {
+        return serve_main(argv[2]);
     }
     
-    // 主循环
-    while (1) {
-        print_prompt();
-        
-        // 读取用户输入
-        char buff[256] = {0};
-        if (fgets(buff, sizeof(buff), stdin) == NULL) {
-            // Ctrl+D 输入EOF，退出shell
-            printf("exit\n");
-            break;
-        }
-        
-        buff[strcspn(buff, "\n")] = '\0'; // 安全去除换行符
-        
-        // 跳过空命令
-        if (strlen(buff) == 0) continue;
-        
-        // 保存原始命令字符串
-        char *command_str = strdup(buff);
-        if (!command_str) {
-            perror("strdup");
-            continue;
-        }
-        
-        // 处理内置命令
-        if (handle_builtin_commands(buff, command_str)) {
-            continue; // 已处理内置命令
-        }
-        
-        // 命令解析
-        char *commands[MAX_COMMANDS][MAX_ARGS_PER_COMMAND];
-        int in_redirect, out_redirect, append, background;
-        char *in_file = NULL, *out_file = NULL;
-        
-        int cmd_count = parse_command(buff, commands, &in_redirect, &out_redirect,
-                                    &append, &in_file, &out_file, &background);
-        
-        if (cmd_count == 0) {
-            free(command_str);
-            continue;
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "%s: -c: option requires an argument\n", argv[0]);
+            return EXIT_USAGE;
         }
-        
-        // 执行逻辑
-        if (cmd_count == 1) {
-            execute_single_command(commands[0],
-                                  in_redirect, in_file,
-                                  out_redirect, out_file,
-                                  append,
-                                  background,
-                                  command_str);
-        } else {
-            execute_pipeline(commands, cmd_count, background, command_str);
+        reader_init_string(&reader, argv[2]);
+    } else if (argc > 1) {
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], argv[1], strerror(errno));
+            return EXIT_NOT_FOUND;
         }
-        
-        free(command_str);
+        reader_init_fd(&reader, fd);
+    } else {
+        reader_init_fd(&reader, STDIN_FILENO);
     }
     
-    return 0;
+    // 初始化作业列表和shell环境
+    init_jobs(argc == 1 && isatty(STDIN_FILENO));
+    if (argc == 1 && !shell_is_interactive) {
+        reader_share(&reader);
+    }
+    if (shell_is_interactive) {
+        init_prompt();
+        editor_init();
+    }
+    
+    // 子进程事件通过signalfd在主循环中处理
+    init_events();
+    
+    // 主循环
+    run_shell(&reader, -1);
+    
+    return last_status;
 }
@@ -0,0 +1,184 @@
+/**
+ * @file mybashc.c
+ * @brief mybash02 --serve 的客户端
+ *
+ * 把当前目录、环境变量、标准输入/输出/错误和脚本交给常驻的mybash02执行，
+ * 命令的输出直接写到本进程的描述符上，不经过套接字转发。
+ * 以脚本最后的退出状态退出。
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "serve.h"
+
+#define EXIT_USAGE 2 // 与mybash02一致
+
+extern char **environ;
+
+/**
+ * @brief 完整写入len字节
+ * @return 成功返回0，失败返回-1
+ */
+int send_full(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief 发送请求头和数据，附带描述符
+ *
+ * 整个请求用一次sendmsg发出，服务端的会话进程一次就能收齐。
+ */
+int send_request(int sock, const ServeHeader *header, const char *payload, size_t len,
+                 const int *fds, int nfds) {
+    struct iovec iov[2] = {{(void *)header, sizeof(*header)}, {(void *)payload, len}};
+    char control[CMSG_SPACE(SERVE_MAX_FDS * sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg = {0};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+    // 剩余部分（套接字缓冲区放不下时）按普通数据补发
+    if ((size_t)n < sizeof(*header)) {
+        if (send_full(sock, (const char *)header + n, sizeof(*header) - n) != 0) return -1;
+        n = 0;
+    } else {
+        n -= sizeof(*header);
+    }
+    return send_full(sock, payload + n, len - n);
+}
+
+/**
+ * @brief 用法：mybashc [-v] socket [-c command | script]
+ *
+ * 不给脚本时从标准输入读取脚本。-v把每行命令的退出状态打印到标准错误。
+ */
+int main(int argc, char *argv[]) {
+    int verbose = 0;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "-v") == 0) {
+        verbose = 1;
+        argi++;
+    }
+    if (argi >= argc || (argi + 1 < argc && strcmp(argv[argi + 1], "-c") == 0 && argi + 2 >= argc)) {
+        fprintf(stderr, "usage: %s [-v] socket [-c command | script]\n", argv[0]);
+        return EXIT_USAGE;
+    }
+    const char *path = argv[argi++];
+
+    ServeHeader header = {SERVE_MAGIC, 0, 0, 0};
+    int fds[SERVE_MAX_FDS];
+    int nfds = 0;
+    const char *text = NULL;
+    int script_fd = STDIN_FILENO;
+    if (argi < argc && strcmp(argv[argi], "-c") == 0) {
+        text = argv[argi + 1];
+        header.text_len = strlen(text);
+        script_fd = -1;
+    } else if (argi < argc) {
+        script_fd = open(argv[argi], O_RDONLY | O_CLOEXEC);
+        if (script_fd < 0) {
+            fprintf(stderr, "%s: %s: %s\n", argv[0], argv[argi], strerror(errno));
+            return 127;
+        }
+    }
+
+    fds[nfds++] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fds[0] < 0) {
+        perror("mybashc: .");
+        return 1;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (fcntl(i, F_GETFD) != -1) {
+            header.flags |= SERVE_STDIN << i;
+            fds[nfds++] = i;
+        }
+    }
+    if (script_fd >= 0) {
+        header.flags |= SERVE_SCRIPT_FD;
+        fds[nfds++] = script_fd;
+    }
+    // 环境变量（每项带'\0'）和-c的命令文本拼成一块
+    for (char **env = environ; *env; env++) {
+        header.env_len += strlen(*env) + 1;
+    }
+    char *payload = malloc(header.env_len + header.text_len + 1);
+    if (!payload) {
+        perror("mybashc: malloc");
+        return 1;
+    }
+    char *p = payload;
+    for (char **env = environ; *env; env++) {
+        p = stpcpy(p, *env) + 1;
+    }
+    if (text) {
+        memcpy(p, text, header.text_len);
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "mybashc: %s: path too long\n", path);
+        return EXIT_USAGE;
+    }
+    strcpy(addr.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "mybashc: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (send_request(sock, &header, payload, header.env_len + header.text_len, fds, nfds) != 0) {
+        perror("mybashc: send");
+        return 1;
+    }
+    close(fds[0]);
+    if (script_fd > STDIN_FILENO) {
+        close(script_fd);
+    }
+
+    // 逐行读取回复：line N STATUS ... exit STATUS
+    FILE *replies = fdopen(sock, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    while (replies && getline(&line, &cap, replies) > 0) {
+        unsigned long lineno;
+        int status;
+        if (sscanf(line, "exit %d", &status) == 1) {
+            return status;
+        }
+        if (verbose && sscanf(line, "line %lu %d", &lineno, &status) == 2) {
+            fprintf(stderr, "mybashc: line %lu: status %d\n", lineno, status);
+        }
+    }
+    fprintf(stderr, "mybashc: %s: connection closed\n", path);
+    return 1;
+}
@@ -0,0 +1,126 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#define CAT_BUF_SIZE (128*1024)	//read/write方式的缓冲区大小
+#define CAT_CHUNK (1<<30)	//零拷贝系统调用每次请求的最大字节数
+
+//复制方式，失败时依次退回到下一种
+enum{CAT_COPY_RANGE,CAT_SENDFILE,CAT_RW,CAT_SPLICE};
+
+//内核不支持这种描述符组合时返回的错误，可以换一种方式继续
+static int cat_unsupported(int err){
+	return err==EINVAL||err==ENOSYS||err==EXDEV||err==EOPNOTSUPP||err==EBADF;
+}
+
+//用户态缓冲区复制，处理部分写入
+static int cat_rw(int in,int out,const char *name){
+	char *buf=malloc(CAT_BUF_SIZE);
+	if(!buf){
+		perror("cat: malloc");
+		return 1;
+	}
+	int ret=0;
+	while(1){
+		ssize_t n=read(in,buf,CAT_BUF_SIZE);
+		if(n==0) break;
+		if(n<0){
+			if(errno==EINTR) continue;
+			fprintf(stderr,"cat: %s: %s\n",name,strerror(errno));
+			ret=1;
+			break;
+		}
+		for(ssize_t done=0;done<n;){
+			ssize_t w=write(out,buf+done,n-done);
+			if(w<0){
+				if(errno==EINTR) continue;
+				fprintf(stderr,"cat: write error: %s\n",strerror(errno));
+				free(buf);
+				return 1;
+			}
+			done+=w;
+		}
+	}
+	free(buf);
+	return ret;
+}
+
+/*
+ * 把in的内容复制到out。普通文件之间用copy_file_range（可能在文件系统内部完成），
+ * 普通文件到其他描述符（管道、套接字）用sendfile，一端是管道时用splice，
+ * 数据都不经过用户态；描述符组合不支持时退回read/write。
+ * 三种调用都使用并推进文件偏移，中途退回也不会重复或遗漏数据。
+ */
+static int cat_fd(int in,int out,const char *name){
+	struct stat ist,ost;
+	int mode=CAT_RW;
+	if(fstat(in,&ist)==0&&fstat(out,&ost)==0){
+		if(S_ISREG(ist.st_mode)&&S_ISREG(ost.st_mode)&&
+		   ist.st_dev==ost.st_dev&&ist.st_ino==ost.st_ino&&ist.st_size>0){
+			fprintf(stderr,"cat: %s: input file is output file\n",name);
+			return 1;
+		}
+		//procfs等文件大小为0但有内容，这类文件只能read
+		if(S_ISREG(ist.st_mode)&&ist.st_size>0){
+			mode=S_ISREG(ost.st_mode)?CAT_COPY_RANGE:CAT_SENDFILE;
+		}else if(S_ISFIFO(ist.st_mode)||S_ISFIFO(ost.st_mode)){
+			mode=CAT_SPLICE;
+		}
+	}
+	while(mode!=CAT_RW){
+		ssize_t n;
+		if(mode==CAT_COPY_RANGE){
+			n=copy_file_range(in,NULL,out,NULL,CAT_CHUNK,0);
+		}else if(mode==CAT_SENDFILE){
+			n=sendfile(out,in,NULL,CAT_CHUNK);
+		}else{
+			n=splice(in,NULL,out,NULL,CAT_CHUNK,SPLICE_F_MOVE);
+		}
+		if(n==0) return 0;
+		if(n>0) continue;
+		if(errno==EINTR) continue;
+		if(!cat_unsupported(errno)){
+			fprintf(stderr,"cat: %s: %s\n",name,strerror(errno));
+			return 1;
+		}
+		mode=(mode==CAT_COPY_RANGE)?CAT_SENDFILE:CAT_RW;
+	}
+	return cat_rw(in,out,name);
+}
+
+int mybin_cat(int argc,char *argv[]){
+	int ret=0;
+	int first=1;
+	if(argc>1&&strcmp(argv[1],"--")==0) first=2;
+	if(first>=argc) return cat_fd(STDIN_FILENO,STDOUT_FILENO,"-");
+	for(int i=first;i<argc;i++){
+		if(strcmp(argv[i],"-")==0){
+			ret|=cat_fd(STDIN_FILENO,STDOUT_FILENO,"-");
+			continue;
+		}
+		int fd=open(argv[i],O_RDONLY|O_CLOEXEC);
+		if(fd<0){
+			fprintf(stderr,"cat: %s: %s\n",argv[i],strerror(errno));
+			ret=1;
+			continue;
+		}
+		ret|=cat_fd(fd,STDOUT_FILENO,argv[i]);
+		close(fd);
+	}
+	return ret;
+}
+
+//作为mybash02的内置命令编译时不需要main
+#ifndef MYBASH_BUILTIN
+int main(int argc,char *argv[]){
+	return mybin_cat(argc,argv);
+}
+#endif
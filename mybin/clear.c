@@ -1,5 +1,13 @@
 #include <stdio.h>
 
-int main(){
+int mybin_clear(int argc,char *argv[]){
 	printf("\033[2J\033[0;0H");
+	return 0;
 }
+
+//作为mybash02的内置命令编译时不需要main
+#ifndef MYBASH_BUILTIN
+int main(int argc,char *argv[]){
+	return mybin_clear(argc,argv);
+}
+#endif
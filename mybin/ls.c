@@ -1,41 +1,723 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <dirent.h>
-int main(){
+#include <fcntl.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-	char path[256]={0};
-	if(getcwd(path,256)==NULL){
-		perror("getcwd err!");
-		exit(1);
+#define LS_DENTS_SIZE (256*1024)//每次getdents64读取的字节数
+#define LS_OUT_SIZE (64*1024)//输出缓冲区大小
+#define WALK_DENTS_SIZE (64*1024)//递归遍历时每个线程的getdents64缓冲区
+
+enum{LS_PLAIN,LS_DIR,LS_EXEC};
+
+typedef struct{
+	size_t name;//名字在names中的偏移
+	int len;
+	int kind;//LS_PLAIN/LS_DIR/LS_EXEC
+}LsEntry;
+
+//所有名字连续存放在names中，ents只记录偏移
+typedef struct{
+	char *names;
+	size_t names_len,names_cap;
+	LsEntry *ents;
+	size_t count,cap;
+}LsList;
+
+typedef struct{
+	char buf[LS_OUT_SIZE];
+	size_t len;
+}LsOut;
+
+static void *ls_grow(void *ptr,size_t *cap,size_t need,size_t elem){
+	if(need<=*cap){
+		return ptr;
 	}
-	DIR *pdir=opendir(path);
-	if(pdir==NULL){
-		perror("opendir err!");
-		exit(0);
+	size_t ncap=*cap?*cap:4096;
+	while(ncap<need){
+		ncap*=2;
 	}
-	struct dirent *s=NULL;
-	while((s=readdir(pdir))!=NULL){
-		if(strncmp(s->d_name,".",1)==0){
-			continue;
+	//失败时返回NULL，原来的内存保持不变；ls在mybash02中运行时不能exit
+	void *grown=realloc(ptr,ncap*elem);
+	if(grown==NULL){
+		perror("realloc err!");
+		return NULL;
+	}
+	*cap=ncap;
+	return grown;
+}
+
+static int ls_push(LsList *list,const char *name,int len,int kind){
+	char *names=ls_grow(list->names,&list->names_cap,list->names_len+len+1,1);
+	if(names==NULL){
+		return -1;
+	}
+	list->names=names;
+	LsEntry *ents=ls_grow(list->ents,&list->cap,list->count+1,sizeof(LsEntry));
+	if(ents==NULL){
+		return -1;
+	}
+	list->ents=ents;
+	memcpy(list->names+list->names_len,name,len+1);
+	LsEntry *e=&list->ents[list->count++];
+	e->name=list->names_len;
+	e->len=len;
+	e->kind=kind;
+	list->names_len+=len+1;
+	return 0;
+}
+
+//d_type已经能区分目录和普通文件，只有DT_UNKNOWN和符号链接需要stat；
+//普通文件只在需要着色（判断可执行位）时才stat
+static int ls_classify(int dirfd,const char *name,int d_type,int color,int *err){
+	if(d_type==DT_DIR){
+		return LS_DIR;
+	}
+	if(d_type!=DT_UNKNOWN&&d_type!=DT_LNK&&(d_type!=DT_REG||!color)){
+		return LS_PLAIN;
+	}
+	struct stat filestat;
+	if(fstatat(dirfd,name,&filestat,0)==-1){
+		//悬空的符号链接按普通文件显示
+		if(!(d_type==DT_LNK&&errno==ENOENT)){
+			fprintf(stderr,"ls: cannot access '%s': %s\n",name,strerror(errno));
+			*err=1;
+		}
+		return LS_PLAIN;
+	}
+	if(S_ISDIR(filestat.st_mode)){
+		return LS_DIR;
+	}
+	if(S_ISREG(filestat.st_mode)&&(filestat.st_mode&(S_IXUSR|S_IXGRP|S_IXOTH))){
+		return LS_EXEC;
+	}
+	return LS_PLAIN;
+}
+
+static int ls_read_dir(int dirfd,LsList *list,int color,int *err){
+	char *dents=malloc(LS_DENTS_SIZE);
+	if(dents==NULL){
+		perror("malloc err!");
+		return -1;
+	}
+	ssize_t n;
+	while((n=getdents64(dirfd,dents,LS_DENTS_SIZE))>0){
+		for(ssize_t off=0;off<n;){
+			struct dirent64 *d=(struct dirent64 *)(dents+off);
+			off+=d->d_reclen;
+			if(d->d_name[0]=='.'){
+				continue;
+			}
+			int kind=ls_classify(dirfd,d->d_name,d->d_type,color,err);
+			if(ls_push(list,d->d_name,strlen(d->d_name),kind)!=0){
+				free(dents);
+				return -1;
+			}
 		}
-		struct stat filestat;
-		stat(s->d_name,&filestat);
-		if(S_ISDIR(filestat.st_mode)){
-			printf("\033[1;34m%s\033[0m   ",s->d_name);
+	}
+	free(dents);
+	if(n<0){
+		perror("getdents64 err!");
+		return -1;
+	}
+	return 0;
+}
+
+static int ls_cmp(const void *a,const void *b,void *names){
+	return strcmp((char *)names+((LsEntry *)a)->name,(char *)names+((LsEntry *)b)->name);
+}
+
+static void ls_flush(LsOut *out){
+	fwrite(out->buf,1,out->len,stdout);
+	out->len=0;
+}
+
+static void ls_write(LsOut *out,const char *data,size_t len){
+	if(out->len+len>LS_OUT_SIZE){
+		ls_flush(out);
+	}
+	if(len>LS_OUT_SIZE){
+		fwrite(data,1,len,stdout);
+		return ;
+	}
+	memcpy(out->buf+out->len,data,len);
+	out->len+=len;
+}
+
+//整行（目录/名字\n）一次放进缓冲区，只在行与行之间刷出，多个线程的输出不会在行中交错
+static void ls_write_path(LsOut *out,const char *dir,size_t dlen,const char *name,size_t nlen){
+	size_t len=dlen+nlen+2;
+	if(out->len+len>LS_OUT_SIZE){
+		ls_flush(out);
+	}
+	if(len>LS_OUT_SIZE){
+		flockfile(stdout);
+		fwrite_unlocked(dir,1,dlen,stdout);
+		fputc_unlocked('/',stdout);
+		fwrite_unlocked(name,1,nlen,stdout);
+		fputc_unlocked('\n',stdout);
+		funlockfile(stdout);
+		return ;
+	}
+	char *p=out->buf+out->len;
+	memcpy(p,dir,dlen);
+	p[dlen]='/';
+	memcpy(p+dlen+1,name,nlen);
+	p[dlen+1+nlen]='\n';
+	out->len+=len;
+}
+
+static void ls_write_entry(LsOut *out,const LsList *list,const LsEntry *e,int color){
+	static const char *const colors[]={"","\033[1;34m","\033[1;32m"};
+	if(color&&e->kind!=LS_PLAIN){
+		ls_write(out,colors[e->kind],strlen(colors[e->kind]));
+		ls_write(out,list->names+e->name,e->len);
+		ls_write(out,"\033[0m",4);
+	}else{
+		ls_write(out,list->names+e->name,e->len);
+	}
+}
+
+//终端上按终端宽度分列（先列后行），否则每行一个名字
+static void ls_print(const LsList *list,int tty){
+	LsOut *out=malloc(sizeof(LsOut));
+	if(out==NULL){
+		perror("malloc err!");
+		return ;
+	}
+	out->len=0;
+	if(!tty){
+		for(size_t i=0;i<list->count;i++){
+			ls_write_entry(out,list,&list->ents[i],0);
+			ls_write(out,"\n",1);
+		}
+		ls_flush(out);
+		free(out);
+		return ;
+	}
+
+	struct winsize ws;
+	int width=80;
+	if(ioctl(STDOUT_FILENO,TIOCGWINSZ,&ws)==0&&ws.ws_col>0){
+		width=ws.ws_col;
+	}
+	int maxlen=0;
+	for(size_t i=0;i<list->count;i++){
+		if(list->ents[i].len>maxlen){
+			maxlen=list->ents[i].len;
+		}
+	}
+	int colw=maxlen+2;
+	size_t cols=width/colw>0?width/colw:1;
+	size_t rows=(list->count+cols-1)/cols;
+	char spaces[64];
+	memset(spaces,' ',sizeof(spaces));
+	for(size_t r=0;r<rows;r++){
+		for(size_t c=0;c<cols;c++){
+			size_t i=c*rows+r;
+			if(i>=list->count){
+				break;
+			}
+			ls_write_entry(out,list,&list->ents[i],1);
+			if(i+rows<list->count){
+				for(int pad=colw-list->ents[i].len;pad>0;pad-=sizeof(spaces)){
+					ls_write(out,spaces,pad<(int)sizeof(spaces)?pad:(int)sizeof(spaces));
+				}
+			}
+		}
+		ls_write(out,"\n",1);
+	}
+	ls_flush(out);
+	free(out);
+}
+
+/**********************************************************************
+ * 递归遍历（ls -R）：多线程工作窃取
+ *
+ * 每个目录是一个任务，节点持有目录fd，子目录用openat相对父目录打开，
+ * 父目录fd按引用计数在所有子目录都打开后关闭。每个线程有自己的双端队列，
+ * 从底部取自己的任务（深度优先），空闲时从其他线程队列的顶部窃取。
+ * 无序模式下结果直接写入线程自己的输出缓冲区；有序模式下保留整棵树，
+ * 遍历结束后按名字排序的先序顺序输出。
+ **********************************************************************/
+
+typedef struct WalkNode WalkNode;
+
+typedef struct{
+	size_t name;//名字在所属节点names中的偏移
+	WalkNode *child;//子目录节点，非目录为NULL
+	int match;//是否满足名字过滤条件
+}WalkEnt;
+
+struct WalkNode{
+	WalkNode *parent;
+	int fd;
+	atomic_int refs;//仍需要fd的任务数（自身扫描+待打开的子目录）
+	int depth;
+	char *path;//完整路径，用于输出和拼接子路径
+	//有序模式下保存的条目
+	char *names;
+	size_t names_len,names_cap;
+	WalkEnt *ents;
+	size_t count,cap;
+	char name[];//在父目录中的名字
+};
+
+typedef struct{
+	pthread_mutex_t lock;
+	WalkNode **items;//[head,tail)为待处理任务
+	size_t head,tail,cap;
+}WalkDeque;
+
+typedef struct{
+	const char *pattern;//名字过滤（fnmatch），NULL表示不过滤
+	int maxdepth;//最大深度，<=0表示不限
+	int ordered;
+	int all;//是否包括以.开头的条目
+	int nthreads;
+	WalkDeque *deques;
+	atomic_long queued;//在队列中的任务数
+	atomic_long pending;//未完成的任务数（队列中+处理中）
+	atomic_int err;
+	pthread_mutex_t idle_lock;
+	pthread_cond_t idle_cond;
+	int waiters;
+}Walk;
+
+typedef struct{
+	Walk *walk;
+	int id;
+	char *dents;
+	LsOut out;
+}WalkWorker;
+
+//队列扩容失败时返回-1，任务没有入队
+static int walk_push(Walk *w,int id,WalkNode *node){
+	WalkDeque *dq=&w->deques[id];
+	pthread_mutex_lock(&dq->lock);
+	if(dq->tail==dq->cap){
+		if(dq->head>0){
+			memmove(dq->items,dq->items+dq->head,(dq->tail-dq->head)*sizeof(WalkNode *));
+			dq->tail-=dq->head;
+			dq->head=0;
+		}else{
+			WalkNode **items=ls_grow(dq->items,&dq->cap,dq->cap+1,sizeof(WalkNode *));
+			if(items==NULL){
+				pthread_mutex_unlock(&dq->lock);
+				return -1;
+			}
+			dq->items=items;
+		}
+	}
+	dq->items[dq->tail++]=node;
+	atomic_fetch_add(&w->pending,1);
+	atomic_fetch_add(&w->queued,1);
+	pthread_mutex_unlock(&dq->lock);
+
+	//在锁内通知，保证不会错过正准备睡眠的线程
+	pthread_mutex_lock(&w->idle_lock);
+	if(w->waiters>0){
+		pthread_cond_signal(&w->idle_cond);
+	}
+	pthread_mutex_unlock(&w->idle_lock);
+	return 0;
+}
+
+//自己的队列从底部取，其他线程的队列从顶部窃取
+static WalkNode *walk_take(Walk *w,int id){
+	for(int i=0;i<w->nthreads;i++){
+		int victim=(id+i)%w->nthreads;
+		WalkDeque *dq=&w->deques[victim];
+		WalkNode *node=NULL;
+		pthread_mutex_lock(&dq->lock);
+		if(dq->head<dq->tail){
+			node=(i==0)?dq->items[--dq->tail]:dq->items[dq->head++];
+			atomic_fetch_sub(&w->queued,1);
+		}
+		pthread_mutex_unlock(&dq->lock);
+		if(node){
+			return node;
+		}
+	}
+	return NULL;
+}
+
+static void walk_release(Walk *w,WalkNode *node){
+	if(atomic_fetch_sub(&node->refs,1)!=1){
+		return ;
+	}
+	close(node->fd);
+	node->fd=-1;
+	//无序模式下子目录已经拼好了自己的路径，节点可以释放
+	if(!w->ordered){
+		free(node->path);
+		free(node);
+	}
+}
+
+static void walk_out_path(WalkWorker *wk,const WalkNode *node,const char *name,size_t len){
+	ls_write_path(&wk->out,node->path,strlen(node->path),name,len);
+}
+
+static void walk_error(Walk *w,const char *path,const char *name){
+	fprintf(stderr,"ls: %s%s%s: %s\n",path,name?"/":"",name?name:"",strerror(errno));
+	atomic_store(&w->err,1);
+}
+
+static int walk_cmp(const void *a,const void *b,void *names){
+	return strcmp((char *)names+((WalkEnt *)a)->name,(char *)names+((WalkEnt *)b)->name);
+}
+
+//有序模式下为一个条目预留names和ents的空间
+static int walk_reserve(WalkNode *node,size_t len){
+	char *names=ls_grow(node->names,&node->names_cap,node->names_len+len+1,1);
+	if(names==NULL){
+		return -1;
+	}
+	node->names=names;
+	WalkEnt *ents=ls_grow(node->ents,&node->cap,node->count+1,sizeof(WalkEnt));
+	if(ents==NULL){
+		return -1;
+	}
+	node->ents=ents;
+	return 0;
+}
+
+//打开并扫描一个目录，子目录作为新任务压入自己的队列
+static void walk_dir(WalkWorker *wk,WalkNode *node){
+	Walk *w=wk->walk;
+	WalkNode *parent=node->parent;
+	if(parent){
+		node->fd=openat(parent->fd,node->name,O_RDONLY|O_DIRECTORY|O_CLOEXEC|O_NOFOLLOW);
+		size_t plen=strlen(parent->path);
+		node->path=malloc(plen+strlen(node->name)+2);
+		if(node->path==NULL){
+			//没有路径就无法输出，这个目录不遍历
+			perror("malloc err!");
+			atomic_store(&w->err,1);
+			if(node->fd!=-1){
+				close(node->fd);
+				node->fd=-1;
+			}
 		}else{
-			if(filestat.st_mode &(S_IXUSR|S_IXGRP|S_IXOTH)){
-				printf("\033[1;32m%s\033[0m   ",s->d_name);
-			}else{
-				printf("%s ",s->d_name);
+			sprintf(node->path,"%s/%s",parent->path,node->name);
+			if(node->fd==-1){
+				walk_error(w,parent->path,node->name);
+			}
+		}
+		walk_release(w,parent);
+	}
+	if(node->fd==-1){
+		walk_release(w,node);
+		return ;
+	}
+
+	ssize_t n;
+	while((n=getdents64(node->fd,wk->dents,WALK_DENTS_SIZE))>0){
+		for(ssize_t off=0;off<n;){
+			struct dirent64 *d=(struct dirent64 *)(wk->dents+off);
+			off+=d->d_reclen;
+			const char *name=d->d_name;
+			if(name[0]=='.'&&(!w->all||name[1]=='\0'||(name[1]=='.'&&name[2]=='\0'))){
+				continue;
+			}
+			size_t len=strlen(name);
+			int isdir=d->d_type==DT_DIR;
+			if(d->d_type==DT_UNKNOWN){
+				struct stat st;
+				if(fstatat(node->fd,name,&st,AT_SYMLINK_NOFOLLOW)==0){
+					isdir=S_ISDIR(st.st_mode);
+				}else{
+					walk_error(w,node->path,name);
+				}
+			}
+			int match=w->pattern==NULL||fnmatch(w->pattern,name,0)==0;
+			//内存不足时跳过这个条目（ls_grow已报告错误）
+			if(w->ordered&&walk_reserve(node,len)!=0){
+				atomic_store(&w->err,1);
+				continue;
+			}
+
+			WalkNode *child=NULL;
+			if(isdir&&(w->maxdepth<=0||node->depth+1<w->maxdepth)){
+				child=calloc(1,sizeof(WalkNode)+len+1);
+				if(child==NULL){
+					//条目照常输出，只是不进入这个子目录
+					perror("calloc err!");
+					atomic_store(&w->err,1);
+				}else{
+					memcpy(child->name,name,len+1);
+					child->parent=node;
+					child->fd=-1;
+					child->depth=node->depth+1;
+					atomic_init(&child->refs,1);
+					atomic_fetch_add(&node->refs,1);
+				}
+			}
+
+			if(w->ordered){
+				memcpy(node->names+node->names_len,name,len+1);
+				WalkEnt *e=&node->ents[node->count++];
+				e->name=node->names_len;
+				e->child=child;
+				e->match=match;
+				node->names_len+=len+1;
+			}else if(match){
+				walk_out_path(wk,node,name,len);
+			}
+			//放不进队列的子目录不遍历，归还它占用的父目录引用
+			if(child&&walk_push(w,wk->id,child)!=0){
+				atomic_store(&w->err,1);
+				walk_release(w,node);
+				if(!w->ordered){
+					free(child);
+				}
+			}
+		}
+	}
+	if(n<0){
+		walk_error(w,node->path,NULL);
+	}
+	if(w->ordered&&node->count>1){
+		qsort_r(node->ents,node->count,sizeof(WalkEnt),walk_cmp,node->names);
+	}
+	walk_release(w,node);
+}
+
+static void *walk_worker(void *arg){
+	WalkWorker *wk=arg;
+	Walk *w=wk->walk;
+	while(1){
+		WalkNode *node=walk_take(w,wk->id);
+		if(node){
+			walk_dir(wk,node);
+			if(atomic_fetch_sub(&w->pending,1)==1){
+				pthread_mutex_lock(&w->idle_lock);
+				pthread_cond_broadcast(&w->idle_cond);
+				pthread_mutex_unlock(&w->idle_lock);
 			}
+			continue;
+		}
+		//没有可取的任务：还有任务在处理中就睡眠等待，全部完成则退出
+		pthread_mutex_lock(&w->idle_lock);
+		while(atomic_load(&w->queued)==0&&atomic_load(&w->pending)>0){
+			w->waiters++;
+			pthread_cond_wait(&w->idle_cond,&w->idle_lock);
+			w->waiters--;
+		}
+		int done=atomic_load(&w->pending)==0;
+		pthread_mutex_unlock(&w->idle_lock);
+		if(done){
+			break;
 		}
 	}
-	printf("\n");
+	ls_flush(&wk->out);
+	return NULL;
+}
 
-	closedir(pdir);
-	exit(0);
+static void walk_print_ordered(LsOut *out,WalkNode *node){
+	for(size_t i=0;i<node->count;i++){
+		WalkEnt *e=&node->ents[i];
+		const char *name=node->names+e->name;
+		if(e->match){
+			ls_write_path(out,node->path,strlen(node->path),name,strlen(name));
+		}
+		if(e->child){
+			walk_print_ordered(out,e->child);
+		}
+	}
 }
 
+static void walk_free(WalkNode *node){
+	for(size_t i=0;i<node->count;i++){
+		if(node->ents[i].child){
+			walk_free(node->ents[i].child);
+		}
+	}
+	free(node->names);
+	free(node->ents);
+	free(node->path);
+	free(node);
+}
+
+//按find的方式每行输出一个路径（不包括根目录本身）
+static int ls_walk(const char *root,Walk *w){
+	WalkNode *top=calloc(1,sizeof(WalkNode)+1);
+	if(top==NULL){
+		perror("calloc err!");
+		return 1;
+	}
+	top->fd=open(root,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if(top->fd==-1){
+		fprintf(stderr,"ls: cannot open directory '%s': %s\n",root,strerror(errno));
+		free(top);
+		return 1;
+	}
+	//根目录为"/"时子路径不重复斜杠
+	size_t rlen=strlen(root);
+	while(rlen>1&&root[rlen-1]=='/'){
+		rlen--;
+	}
+	top->path=strndup(root,rlen==1&&root[0]=='/'?0:rlen);
+	atomic_init(&top->refs,1);
+
+	//ls在mybash02中运行，分配失败时返回错误而不是exit
+	w->deques=calloc(w->nthreads,sizeof(WalkDeque));
+	WalkWorker *workers=calloc(w->nthreads,sizeof(WalkWorker));
+	pthread_t *tids=calloc(w->nthreads,sizeof(pthread_t));
+	if(top->path==NULL||w->deques==NULL||workers==NULL||tids==NULL){
+		perror("calloc err!");
+		free(w->deques);
+		free(workers);
+		free(tids);
+		close(top->fd);
+		free(top->path);
+		free(top);
+		return 1;
+	}
+	atomic_init(&w->queued,0);
+	atomic_init(&w->pending,0);
+	atomic_init(&w->err,0);
+	pthread_mutex_init(&w->idle_lock,NULL);
+	pthread_cond_init(&w->idle_cond,NULL);
+	w->waiters=0;
+	for(int i=0;i<w->nthreads;i++){
+		pthread_mutex_init(&w->deques[i].lock,NULL);
+		workers[i].walk=w;
+		workers[i].id=i;
+		workers[i].dents=malloc(WALK_DENTS_SIZE);
+		if(workers[i].dents==NULL){
+			perror("malloc err!");
+			atomic_store(&w->err,1);
+		}
+	}
+	if(!atomic_load(&w->err)&&walk_push(w,0,top)==0){
+		//当前线程作为0号工作线程
+		int started=1;
+		for(int i=1;i<w->nthreads;i++){
+			if(pthread_create(&tids[i],NULL,walk_worker,&workers[i])!=0){
+				break;
+			}
+			started++;
+		}
+		walk_worker(&workers[0]);
+		for(int i=1;i<started;i++){
+			pthread_join(tids[i],NULL);
+		}
+	}else{
+		atomic_store(&w->err,1);
+		walk_release(w,top);
+	}
+
+	if(w->ordered){
+		LsOut *out=&workers[0].out;
+		walk_print_ordered(out,top);
+		ls_flush(out);
+		walk_free(top);
+	}
+	for(int i=0;i<w->nthreads;i++){
+		pthread_mutex_destroy(&w->deques[i].lock);
+		free(w->deques[i].items);
+		free(workers[i].dents);
+	}
+	free(w->deques);
+	free(workers);
+	free(tids);
+	pthread_mutex_destroy(&w->idle_lock);
+	pthread_cond_destroy(&w->idle_cond);
+	return atomic_load(&w->err);
+}
+
+static void ls_usage(){
+	fprintf(stderr,"usage: ls [dir]\n"
+		"       ls -R [-U] [-a] [-j threads] [-D maxdepth] [-P pattern] [dir]\n");
+}
+
+//带-R时遍历可能持续很久，mybash02据此把ls放到子进程中作为作业运行
+int mybin_ls_recursive(char **argv){
+	for(int i=1;argv[i];i++){
+		if(strcmp(argv[i],"--")==0){
+			break;
+		}
+		if(argv[i][0]!='-'){
+			continue;
+		}
+		for(const char *p=argv[i]+1;*p;p++){
+			if(*p=='R'){
+				return 1;
+			}
+			if(strchr("jDP",*p)!=NULL){
+				//选项参数在同一个单词里，或者是下一个单词
+				if(p[1]=='\0'&&argv[i+1]!=NULL){
+					i++;
+				}
+				break;
+			}
+		}
+	}
+	return 0;
+}
+
+int mybin_ls(int argc,char *argv[]){
+	Walk w={0};
+	int recursive=0;
+	w.ordered=1;
+	w.nthreads=sysconf(_SC_NPROCESSORS_ONLN);
+	//在shell中反复调用时需要重新初始化getopt
+	optind=0;
+	int opt;
+	while((opt=getopt(argc,argv,"RUaj:D:P:"))!=-1){
+		switch(opt){
+			case 'R': recursive=1; break;
+			case 'U': w.ordered=0; break;
+			case 'a': w.all=1; break;
+			case 'j': w.nthreads=atoi(optarg); break;
+			case 'D': w.maxdepth=atoi(optarg); break;
+			case 'P': w.pattern=optarg; break;
+			default: ls_usage(); return 2;
+		}
+	}
+	if(w.nthreads<1){
+		w.nthreads=1;
+	}
+	const char *path=optind<argc?argv[optind]:".";
+	if(recursive){
+		return ls_walk(path,&w);
+	}
+
+	int dirfd=open(path,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if(dirfd==-1){
+		fprintf(stderr,"ls: cannot open directory '%s': %s\n",path,strerror(errno));
+		return 1;
+	}
+	int tty=isatty(STDOUT_FILENO);
+	int err=0;
+	LsList list={0};
+	if(ls_read_dir(dirfd,&list,tty,&err)==0){
+		qsort_r(list.ents,list.count,sizeof(LsEntry),ls_cmp,list.names);
+		ls_print(&list,tty);
+	}else{
+		err=1;
+	}
+	free(list.names);
+	free(list.ents);
+	close(dirfd);
+	return err;
+}
+
+//作为mybash02的内置命令编译时不需要main
+#ifndef MYBASH_BUILTIN
+int main(int argc,char *argv[]){
+	exit(mybin_ls(argc,argv));
+}
+#endif
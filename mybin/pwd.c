@@ -1,13 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h> 
+#include <limits.h>
 
-int main(){
-	char path[256]={0};
-	if(getcwd(path,256)==NULL){
+int mybin_pwd(int argc,char *argv[]){
+	char path[PATH_MAX]={0};
+	if(getcwd(path,PATH_MAX)==NULL){
 		perror("getcwd err!");
-		exit(1);
+		return 1;
 	}
 	printf("%s\n",path);
-	exit(0);
+	return 0;
 }
+
+//作为mybash02的内置命令编译时不需要main
+#ifndef MYBASH_BUILTIN
+int main(int argc,char *argv[]){
+	exit(mybin_pwd(argc,argv));
+}
+#endif
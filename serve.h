@@ -0,0 +1,33 @@
+/**
+ * @file serve.h
+ * @brief mybash02 --serve 与客户端 mybashc 之间的协议
+ *
+ * 客户端连接AF_UNIX流式套接字后发送一个ServeHeader，同一条消息用SCM_RIGHTS
+ * 附带描述符：当前目录（O_PATH）、flags中标出的标准输入/输出/错误，
+ * 以及SERVE_SCRIPT_FD时的脚本描述符，按此顺序排列。随后是env_len字节的
+ * 环境变量（每项以'\0'结尾）和text_len字节的脚本文本（没有脚本描述符时使用）。
+ *
+ * 服务端每执行完一行命令回复一行"line 行号 退出状态\n"，
+ * 会话结束时回复"exit 退出状态\n"并关闭连接。
+ */
+#ifndef MYBASH_SERVE_H
+#define MYBASH_SERVE_H
+
+#include <stdint.h>
+
+#define SERVE_MAGIC 0x6d796232u // "myb2"
+#define SERVE_STDIN  (1u << 0)
+#define SERVE_STDOUT (1u << 1)
+#define SERVE_STDERR (1u << 2)
+#define SERVE_SCRIPT_FD (1u << 3) // 脚本从附带的描述符读取
+#define SERVE_MAX_FDS 5           // 当前目录、三个标准描述符和脚本
+#define SERVE_MAX_PAYLOAD (64u << 20) // 环境变量和脚本文本的总长度上限
+
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t env_len;  // 环境变量字节数
+    uint32_t text_len; // 脚本文本字节数
+} ServeHeader;
+
+#endif